@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+/**
+ * @brief Something that happens at one time of a clip, e.g. a footstep. What id and value mean is up to
+ * the game; they are plain numbers so events can be copied around without allocating.
+ */
+struct AnimationEvent
+{
+	/*in ticks*/
+	float time;
+	int id;
+	float value;
+};
+
+/**
+ * @brief An event as it reaches a queue: which player crossed it (the source given to the player).
+ */
+struct FiredAnimationEvent
+{
+	AnimationEvent event;
+	int source;
+};
+
+/**
+ * @brief The events of one clip, sorted by time, so the ones a player crosses in an update are found by
+ * binary search instead of a walk over the track.
+ */
+class AnimationEventTrack
+{
+public:
+	void add(float time, int id, float value = 0.0f)
+	{
+		AnimationEvent event = { time, id, value };
+		auto at = std::upper_bound(m_Events.begin(), m_Events.end(), time,
+			[](float t, const AnimationEvent& e) { return t < e.time; });
+		m_Events.insert(at, event);
+	}
+
+	bool empty() const { return m_Events.empty(); }
+	const std::vector<AnimationEvent>& getEvents() const { return m_Events; }
+
+	/**
+	 * @brief Calls fire(event) for each event in [fromTime, toTime), in order. wrapped: a looping player
+	 * passed the end of the clip in between, so the range is [fromTime, end) and then [0, toTime).
+	 */
+	template<class F>
+	void Collect(float fromTime, float toTime, bool wrapped, F&& fire) const
+	{
+		if (m_Events.empty())
+			return;
+		if (!wrapped)
+		{
+			Range(fromTime, toTime, fire);
+			return;
+		}
+		Range(fromTime, std::numeric_limits<float>::infinity(), fire);
+		Range(-std::numeric_limits<float>::infinity(), toTime, fire);
+	}
+
+private:
+	template<class F>
+	void Range(float fromTime, float toTime, F& fire) const
+	{
+		auto byTime = [](const AnimationEvent& e, float t) { return e.time < t; };
+		auto first = std::lower_bound(m_Events.begin(), m_Events.end(), fromTime, byTime);
+		auto last = std::lower_bound(first, m_Events.end(), toTime, byTime);
+		for (auto it = first; it != last; ++it)
+			fire(*it);
+	}
+
+	std::vector<AnimationEvent> m_Events;
+};
+
+/**
+ * @brief A fixed-size ring of fired events, filled by players during their updates and drained by the
+ * game once per frame. It never allocates after construction; when full, the oldest events are dropped
+ * and counted.
+ */
+class AnimationEventQueue
+{
+public:
+	explicit AnimationEventQueue(size_t capacity = 64)
+		: m_Events(capacity)
+	{
+	}
+
+	void push(const AnimationEvent& event, int source)
+	{
+		if (m_Events.empty())
+			return;
+		if (m_Count == m_Events.size())
+		{
+			m_Head = (m_Head + 1) % m_Events.size();
+			m_Count--;
+			m_Dropped++;
+		}
+		m_Events[(m_Head + m_Count) % m_Events.size()] = { event, source };
+		m_Count++;
+	}
+
+	/*takes the oldest event; false when there is none*/
+	bool pop(FiredAnimationEvent& fired)
+	{
+		if (m_Count == 0)
+			return false;
+		fired = m_Events[m_Head];
+		m_Head = (m_Head + 1) % m_Events.size();
+		m_Count--;
+		return true;
+	}
+
+	size_t size() const { return m_Count; }
+	bool empty() const { return m_Count == 0; }
+	void clear() { m_Head = 0; m_Count = 0; }
+
+	/*events lost to a full queue since construction*/
+	size_t getDropped() const { return m_Dropped; }
+
+private:
+	std::vector<FiredAnimationEvent> m_Events;
+	size_t m_Head = 0;
+	size_t m_Count = 0;
+	size_t m_Dropped = 0;
+};
@@ -0,0 +1,481 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include "SkeletalAnimation.h"
+#include "SkeletalPose.h"
+#include "Inertialization.h"
+
+/*weights at or below this count as zero: the node behind them is neither updated nor sampled*/
+const float MIN_BLEND_WEIGHT = 1e-4f;
+
+/**
+ * @brief A node of an AnimationGraph. Nodes with non-zero weight are updated once per frame and then
+ * add their weighted pose into the graph's single accumulator pose, so a node that does not contribute
+ * costs nothing, however many states or blend samples the graph has.
+ */
+class AnimationNode
+{
+public:
+	virtual ~AnimationNode() = default;
+
+	/*advances the node's clocks by dt seconds and works out the weights of its children*/
+	virtual void Update(float dt) = 0;
+
+	/*adds the node's pose, scaled by weight, into an accumulator prepared with SkeletalPose::ClearWeighted*/
+	virtual void Evaluate(float weight, SkeletalPose& accumulator) = 0;
+
+	/*restarts the node's clips from their first frame*/
+	virtual void Reset() = 0;
+};
+
+/**
+ * @brief Plays one SkeletalAnimation.
+ */
+class ClipNode : public AnimationNode
+{
+public:
+	ClipNode(SkeletalAnimation* animation, bool loop = true, float speed = 1.0f)
+		: m_Animation(animation), m_Loop(loop), m_Speed(speed), m_Time(0.0f)
+	{
+	}
+
+	void Update(float dt) override
+	{
+		float previous = m_Time;
+		m_Time += m_Animation->GetTicksPerSecond() * dt * m_Speed;
+		bool wrapped = m_Loop && m_Time >= m_Animation->GetDuration();
+		if (m_Loop)
+			m_Time = fmod(m_Time, m_Animation->GetDuration());
+		else
+			m_Time = std::min(m_Time, m_Animation->GetDuration());
+		m_RootMotion = m_Animation->GetRootMotion(previous, m_Time, wrapped);
+		if (m_EventQueue)
+			m_Animation->GetEvents().Collect(previous, m_Time, wrapped, [this](const AnimationEvent& event)
+			{
+				m_EventQueue->push(event, m_EventSource);
+			});
+	}
+
+	void Evaluate(float weight, SkeletalPose& accumulator) override
+	{
+		// Bone keys are sampled in [first, last) key, so hold the last frame just before the end.
+		float time = std::min(m_Time, std::nextafter(m_Animation->GetDuration(), 0.0f));
+		m_Animation->AccumulatePose(time, weight, accumulator);
+		accumulator.rootMotion.Accumulate(m_RootMotion, weight);
+	}
+
+	void Reset() override
+	{
+		m_Time = 0.0f;
+		m_RootMotion = RootMotion();
+	}
+
+	/*whether a non-looping clip has reached its end*/
+	bool finished() const
+	{
+		return !m_Loop && m_Time >= m_Animation->GetDuration();
+	}
+
+	float getCurrentTime() const { return m_Time; }
+	void setSpeed(float speed) { m_Speed = speed; }
+
+	/*sends the events the clip crosses while the node plays to queue, tagged with source*/
+	void setEventQueue(AnimationEventQueue* queue, int source = 0)
+	{
+		m_EventQueue = queue;
+		m_EventSource = source;
+	}
+
+private:
+	SkeletalAnimation* m_Animation;
+	bool m_Loop;
+	float m_Speed;
+	float m_Time;
+	/*the clip's root motion over the last Update*/
+	RootMotion m_RootMotion;
+	AnimationEventQueue* m_EventQueue = nullptr;
+	int m_EventSource = 0;
+};
+
+/**
+ * @brief Blends children placed along one parameter axis (e.g. speed). At most the two samples around
+ * the parameter have non-zero weight.
+ */
+class BlendSpace1DNode : public AnimationNode
+{
+public:
+	void addSample(float position, std::unique_ptr<AnimationNode> node)
+	{
+		auto at = std::upper_bound(m_Positions.begin(), m_Positions.end(), position);
+		size_t index = at - m_Positions.begin();
+		m_Positions.insert(at, position);
+		m_Children.insert(m_Children.begin() + index, std::move(node));
+		m_Weights.insert(m_Weights.begin() + index, 0.0f);
+	}
+
+	void setParameter(float value) { m_Parameter = value; }
+
+	void Update(float dt) override
+	{
+		std::fill(m_Weights.begin(), m_Weights.end(), 0.0f);
+		if (m_Children.empty())
+			return;
+
+		float value = glm::clamp(m_Parameter, m_Positions.front(), m_Positions.back());
+		size_t upper = std::upper_bound(m_Positions.begin(), m_Positions.end(), value) - m_Positions.begin();
+		if (upper == 0 || upper == m_Positions.size()) {
+			m_Weights[upper == 0 ? 0 : upper - 1] = 1.0f;
+		}
+		else {
+			float t = (value - m_Positions[upper - 1]) / (m_Positions[upper] - m_Positions[upper - 1]);
+			m_Weights[upper - 1] = 1.0f - t;
+			m_Weights[upper] = t;
+		}
+
+		for (size_t i = 0; i < m_Children.size(); i++)
+			if (m_Weights[i] > MIN_BLEND_WEIGHT)
+				m_Children[i]->Update(dt);
+	}
+
+	void Evaluate(float weight, SkeletalPose& accumulator) override
+	{
+		for (size_t i = 0; i < m_Children.size(); i++)
+			if (m_Weights[i] > MIN_BLEND_WEIGHT)
+				m_Children[i]->Evaluate(weight * m_Weights[i], accumulator);
+	}
+
+	void Reset() override
+	{
+		for (auto& child : m_Children)
+			child->Reset();
+	}
+
+private:
+	std::vector<float> m_Positions;
+	std::vector<std::unique_ptr<AnimationNode>> m_Children;
+	std::vector<float> m_Weights;
+	float m_Parameter = 0.0f;
+};
+
+/**
+ * @brief Blends children placed on a 2D parameter plane (e.g. velocity in x and z) with gradient band
+ * interpolation: a sample's weight falls to zero past its neighbours, so only the samples surrounding the
+ * parameter are evaluated, and the parameter at a sample's position plays that sample alone.
+ */
+class BlendSpace2DNode : public AnimationNode
+{
+public:
+	void addSample(const glm::vec2& position, std::unique_ptr<AnimationNode> node)
+	{
+		m_Positions.push_back(position);
+		m_Children.push_back(std::move(node));
+		m_Weights.push_back(0.0f);
+	}
+
+	void setParameter(const glm::vec2& value) { m_Parameter = value; }
+
+	void Update(float dt) override
+	{
+		float total = 0.0f;
+		for (size_t i = 0; i < m_Children.size(); i++) {
+			float weight = 1.0f;
+			glm::vec2 toParameter = m_Parameter - m_Positions[i];
+			for (size_t j = 0; j < m_Children.size() && weight > 0.0f; j++) {
+				if (i == j)
+					continue;
+				glm::vec2 toSample = m_Positions[j] - m_Positions[i];
+				float lengthSquared = glm::dot(toSample, toSample);
+				if (lengthSquared > 0.0f)
+					weight = std::min(weight, glm::clamp(1.0f - glm::dot(toParameter, toSample) / lengthSquared, 0.0f, 1.0f));
+			}
+			m_Weights[i] = weight;
+			total += weight;
+		}
+
+		for (size_t i = 0; i < m_Children.size(); i++) {
+			m_Weights[i] = total > 0.0f ? m_Weights[i] / total : 0.0f;
+			if (m_Weights[i] > MIN_BLEND_WEIGHT)
+				m_Children[i]->Update(dt);
+		}
+	}
+
+	void Evaluate(float weight, SkeletalPose& accumulator) override
+	{
+		for (size_t i = 0; i < m_Children.size(); i++)
+			if (m_Weights[i] > MIN_BLEND_WEIGHT)
+				m_Children[i]->Evaluate(weight * m_Weights[i], accumulator);
+	}
+
+	void Reset() override
+	{
+		for (auto& child : m_Children)
+			child->Reset();
+	}
+
+private:
+	std::vector<glm::vec2> m_Positions;
+	std::vector<std::unique_ptr<AnimationNode>> m_Children;
+	std::vector<float> m_Weights;
+	glm::vec2 m_Parameter = glm::vec2(0.0f);
+};
+
+/**
+ * @brief Fades between two children over a fixed time, toward whichever one was last selected
+ * (e.g. a weapon held up or lowered). Once a fade completes, only the selected child is evaluated.
+ */
+class CrossfadeNode : public AnimationNode
+{
+public:
+	CrossfadeNode(std::unique_ptr<AnimationNode> first, std::unique_ptr<AnimationNode> second, float duration)
+		: m_Duration(duration)
+	{
+		m_Children[0] = std::move(first);
+		m_Children[1] = std::move(second);
+	}
+
+	/*starts fading toward child 0 or 1*/
+	void select(int child) { m_Target = child == 0 ? 0.0f : 1.0f; }
+
+	void Update(float dt) override
+	{
+		float step = m_Duration > 0.0f ? dt / m_Duration : 1.0f;
+		m_Alpha = m_Target > m_Alpha ? std::min(m_Target, m_Alpha + step) : std::max(m_Target, m_Alpha - step);
+		if (1.0f - m_Alpha > MIN_BLEND_WEIGHT)
+			m_Children[0]->Update(dt);
+		if (m_Alpha > MIN_BLEND_WEIGHT)
+			m_Children[1]->Update(dt);
+	}
+
+	void Evaluate(float weight, SkeletalPose& accumulator) override
+	{
+		if (1.0f - m_Alpha > MIN_BLEND_WEIGHT)
+			m_Children[0]->Evaluate(weight * (1.0f - m_Alpha), accumulator);
+		if (m_Alpha > MIN_BLEND_WEIGHT)
+			m_Children[1]->Evaluate(weight * m_Alpha, accumulator);
+	}
+
+	void Reset() override
+	{
+		m_Children[0]->Reset();
+		m_Children[1]->Reset();
+	}
+
+private:
+	std::unique_ptr<AnimationNode> m_Children[2];
+	float m_Duration;
+	float m_Alpha = 0.0f;
+	float m_Target = 0.0f;
+};
+
+/**
+ * @brief Plays one of several states, crossfading on every state change. A change during a fade
+ * continues from the current blend, so states that are still fading out keep their weight and are
+ * evaluated until it reaches zero; all other states cost nothing.
+ */
+class StateMachineNode : public AnimationNode
+{
+public:
+	/**
+	 * @param defaultDuration the crossfade time, in seconds, of transitions without their own duration.
+	 */
+	StateMachineNode(float defaultDuration)
+		: m_DefaultDuration(defaultDuration)
+	{
+	}
+
+	/**
+	 * @param resetOnEnter restart the state's clips every time it is entered (e.g. a jump).
+	 * @return the index of the new state.
+	 */
+	int addState(std::unique_ptr<AnimationNode> node, bool resetOnEnter = false)
+	{
+		m_States.push_back({ std::move(node), resetOnEnter });
+		return (int)m_States.size() - 1;
+	}
+
+	/*overrides the crossfade time from one state to another*/
+	void setTransitionDuration(int from, int to, float duration)
+	{
+		m_Durations[{ from, to }] = duration;
+	}
+
+	/**
+	 * @brief Switches to a state; the first call, and calling with the current state, do not fade.
+	 * @return whether the state changed.
+	 */
+	bool setState(int state)
+	{
+		if (state == m_Current)
+			return false;
+
+		auto active = std::find_if(m_Active.begin(), m_Active.end(),
+			[state](const ActiveState& a) { return a.state == state; });
+		if (m_Current < 0) {
+			m_Active.clear();
+			m_Active.push_back({ state, 1.0f });
+		}
+		else if (active == m_Active.end()) {
+			if (m_States[state].resetOnEnter)
+				m_States[state].node->Reset();
+			m_Active.push_back({ state, 0.0f });
+		}
+
+		auto duration = m_Durations.find({ m_Current, state });
+		m_FadeDuration = duration == m_Durations.end() ? m_DefaultDuration : duration->second;
+		m_Current = state;
+		return true;
+	}
+
+	int getState() const { return m_Current; }
+
+	void Update(float dt) override
+	{
+		// Raise the current state's weight and scale the fading states down so weights still sum to one.
+		auto current = std::find_if(m_Active.begin(), m_Active.end(),
+			[this](const ActiveState& a) { return a.state == m_Current; });
+		if (current != m_Active.end() && current->weight < 1.0f) {
+			float weight = m_FadeDuration > 0.0f ? std::min(1.0f, current->weight + dt / m_FadeDuration) : 1.0f;
+			float others = (1.0f - weight) / (1.0f - current->weight);
+			for (auto& a : m_Active)
+				a.weight = a.state == m_Current ? weight : a.weight * others;
+			m_Active.erase(std::remove_if(m_Active.begin(), m_Active.end(),
+				[this](const ActiveState& a) { return a.state != m_Current && a.weight <= MIN_BLEND_WEIGHT; }), m_Active.end());
+		}
+
+		for (auto& a : m_Active)
+			m_States[a.state].node->Update(dt);
+	}
+
+	void Evaluate(float weight, SkeletalPose& accumulator) override
+	{
+		for (auto& a : m_Active)
+			m_States[a.state].node->Evaluate(weight * a.weight, accumulator);
+	}
+
+	void Reset() override
+	{
+		for (auto& a : m_Active)
+			m_States[a.state].node->Reset();
+	}
+
+private:
+	struct State
+	{
+		std::unique_ptr<AnimationNode> node;
+		bool resetOnEnter;
+	};
+
+	struct ActiveState
+	{
+		int state;
+		float weight;
+	};
+
+	std::vector<State> m_States;
+	std::vector<ActiveState> m_Active;
+	std::map<std::pair<int, int>, float> m_Durations;
+	float m_DefaultDuration;
+	float m_FadeDuration = 0.0f;
+	int m_Current = -1;
+};
+
+/**
+ * @brief Evaluates a tree of AnimationNodes into the final bone matrices of one character.
+ * Every clip that contributes is sampled straight into one accumulator pose, which is then composed
+ * into matrices once, so the per-frame cost follows the number of clips actually blending rather than
+ * the size of the graph.
+ */
+class AnimationGraph
+{
+public:
+	/**
+	 * @param skeleton any clip loaded against the character's model, used for the bone hierarchy and
+	 * for the bind pose of bones no playing clip animates. Load it last, so its bone map includes the
+	 * bones added by every other clip.
+	 */
+	AnimationGraph(SkeletalAnimation* skeleton, std::unique_ptr<AnimationNode> root)
+		: m_Skeleton(skeleton), m_Root(std::move(root))
+	{
+		m_FinalBoneMatrices.assign(skeleton->getBonesSize(), glm::mat4(1.0f));
+	}
+
+	void UpdateAnimation(float dt)
+	{
+		m_Root->Update(dt);
+
+		// Keep the last two output poses for inertialization; swapping buffers avoids copying poses.
+		std::swap(m_OlderPose, m_PreviousPose);
+		std::swap(m_PreviousPose, m_Pose);
+		m_Pose.ClearWeighted(m_FinalBoneMatrices.size());
+		m_Root->Evaluate(1.0f, m_Pose);
+		m_Pose.NormalizeWeighted(&m_Skeleton->GetBindPose());
+
+		if (m_PendingBlendTime > 0.0f && m_PreviousPose.size() == m_Pose.size())
+			m_Inertializer.start(m_PreviousPose, m_OlderPose.size() == m_Pose.size() ? m_OlderPose : m_PreviousPose,
+				m_LastDt, m_Pose, m_PendingBlendTime);
+		m_PendingBlendTime = 0.0f;
+		if (m_Inertializer.active())
+			m_Inertializer.apply(dt, m_Pose);
+		m_LastDt = dt;
+
+		m_Skeleton->ComposePose(m_Pose, m_FinalBoneMatrices);
+		m_PaletteVersion++;
+	}
+
+	/**
+	 * @brief Blends from the current output into whatever the graph produces next by inertialization,
+	 * over at most blendTime seconds. Use together with state changes that cut instantly (a
+	 * StateMachineNode with a zero fade time), so only the new state is sampled during the transition.
+	 */
+	void inertialize(float blendTime)
+	{
+		m_PendingBlendTime = blendTime;
+	}
+
+	/*the blended root motion of the last update, from the clips that extract it*/
+	const RootMotion& GetRootMotion() const
+	{
+		return m_Pose.rootMotion;
+	}
+
+	/*the palette of the last update, valid until the next one*/
+	const std::vector<glm::mat4>& GetFinalBoneMatrices() const
+	{
+		return m_FinalBoneMatrices;
+	}
+
+	/*changes whenever the palette does (see SkeletalAnimator::GetPaletteVersion)*/
+	uint64_t GetPaletteVersion() const
+	{
+		return m_PaletteVersion;
+	}
+
+	/*the blended TRS pose behind the last computed bone matrices*/
+	const SkeletalPose& GetPose() const
+	{
+		return m_Pose;
+	}
+
+	AnimationNode& getRoot()
+	{
+		return *m_Root;
+	}
+
+private:
+	SkeletalAnimation* m_Skeleton;
+	std::unique_ptr<AnimationNode> m_Root;
+	SkeletalPose m_Pose;
+	SkeletalPose m_PreviousPose;
+	SkeletalPose m_OlderPose;
+	PoseInertializer m_Inertializer;
+	float m_PendingBlendTime = 0.0f;
+	float m_LastDt = 0.0f;
+	std::vector<glm::mat4> m_FinalBoneMatrices;
+	uint64_t m_PaletteVersion = 0;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include "SkeletalAnimation.h"
+#include "Skeletal.h"
+
+/**
+ * @brief Loads every clip of an animation file once and shares it between all Skeletal instances of
+ * the same skeleton. Clips are owned by the library; players only read them (see PoseWorkspace for
+ * evaluating one clip from several threads), while setup code may still Compress() or Resample() them.
+ */
+class AnimationLibrary
+{
+public:
+	/**
+	 * @brief Every clip in the file for model's skeleton, in file order. The first request imports the
+	 * file's animation data; models the clips already fit (see SkeletalAnimation::IsCompatible) get the
+	 * same clips, and other rigs with the same bone names get remapped copies, made once per rig.
+	 * The returned list stays valid for the library's lifetime.
+	 */
+	const std::vector<SkeletalAnimation*>& load(const std::string& path, Skeletal* model)
+	{
+		std::deque<ClipSet>& sets = m_Files[path];
+		for (ClipSet& set : sets)
+			if (set.clips.empty() || set.clips.front()->IsCompatible(*model))
+				return set.view;
+
+		ClipSet set;
+		if (sets.empty())
+		{
+			Assimp::Importer importer;
+			const aiScene* scene = importer.ReadFile(path, SkeletalAnimation::IMPORT_FLAGS);
+			assert(scene && scene->mRootNode);
+			std::cout << "Animation count: " << scene->mNumAnimations << "\n";
+			for (unsigned int i = 0; i < scene->mNumAnimations; i++)
+				set.clips.push_back(std::make_unique<SkeletalAnimation>(scene, scene->mAnimations[i], model));
+		}
+		else
+		{
+			for (auto& clip : sets.front().clips)
+				set.clips.push_back(std::make_unique<SkeletalAnimation>(clip->RemapTo(*model)));
+		}
+		for (auto& clip : set.clips)
+			set.view.push_back(clip.get());
+		sets.push_back(std::move(set));
+		return sets.back().view;
+	}
+
+	/**
+	 * @brief The clip of the file with the given name, for model's skeleton, or nullptr.
+	 */
+	SkeletalAnimation* find(const std::string& path, const std::string& name, Skeletal* model)
+	{
+		for (SkeletalAnimation* clip : load(path, model))
+			if (clip->GetName() == name)
+				return clip;
+		return nullptr;
+	}
+
+	/*the number of clips held, counting each remapped copy*/
+	size_t getClipCount() const
+	{
+		size_t count = 0;
+		for (auto& [path, sets] : m_Files)
+			for (auto& set : sets)
+				count += set.clips.size();
+		return count;
+	}
+
+private:
+	/**
+	 * @brief The clips of one file for one rig; view holds the same clips as plain pointers. The sets of a
+	 * file are kept in a deque, so adding one for another rig leaves the views already returned in place.
+	 */
+	struct ClipSet
+	{
+		std::vector<std::unique_ptr<SkeletalAnimation>> clips;
+		std::vector<SkeletalAnimation*> view;
+	};
+
+	std::unordered_map<std::string, std::deque<ClipSet>> m_Files;
+};
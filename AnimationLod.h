@@ -0,0 +1,195 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <limits>
+#include <glm/glm.hpp>
+#include "SkeletalAnimator.h"
+
+/**
+ * @brief How a character is animated while it is closer to the camera than maxDistance.
+ */
+struct AnimationLodLevel
+{
+	float maxDistance;
+	/*pose updates per second; 0 updates every frame*/
+	float updatesPerSecond;
+	/*bones deeper than this follow their parent (see SkeletalAnimation::ComposePose); INT_MAX keeps all*/
+	int maxBoneDepth;
+};
+
+/**
+ * @brief The budgets of an AnimationLodPolicy. Bone depth counts bones from the root, so on the Mixamo
+ * rigs the hands are at depth 8 and everything below them is fingers.
+ */
+struct AnimationLodSettings
+{
+	/*sorted by maxDistance; characters beyond the last level use the last level*/
+	std::vector<AnimationLodLevel> levels = {
+		{ 12.0f, 0.0f, INT_MAX },
+		{ 30.0f, 30.0f, 8 },
+		{ std::numeric_limits<float>::max(), 15.0f, 8 },
+	};
+	/*used instead of the distance levels for characters outside the view*/
+	AnimationLodLevel offscreen = { 0.0f, 4.0f, 4 };
+	/*blend the last two palettes between updates, instead of holding the last one*/
+	bool interpolate = true;
+};
+
+/**
+ * @brief The work done and skipped in one frame, summed over every character.
+ */
+struct AnimationLodStats
+{
+	int characters = 0;
+	int offscreen = 0;
+	int updates = 0;
+	int skippedUpdates = 0;
+	/*bones left out of the updates that did run*/
+	int prunedBones = 0;
+	int interpolatedPalettes = 0;
+};
+
+/**
+ * @brief Picks a level for each character from its distance to the camera and whether its bounding
+ * sphere is in view, and gathers what the characters skipped this frame.
+ */
+class AnimationLodPolicy
+{
+public:
+	AnimationLodPolicy(const AnimationLodSettings& settings = AnimationLodSettings())
+		: m_Settings(settings)
+	{
+	}
+
+	/*starts a new frame seen through viewProjection from cameraPosition, and resets the frame stats*/
+	void beginFrame(const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+	{
+		m_CameraPosition = cameraPosition;
+		// Gribb-Hartmann: each frustum plane is the last row of the matrix plus or minus another row.
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+			rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+		for (int i = 0; i < 3; i++)
+		{
+			m_Planes[2 * i] = rows[3] + rows[i];
+			m_Planes[2 * i + 1] = rows[3] - rows[i];
+		}
+		for (glm::vec4& plane : m_Planes)
+			plane /= glm::length(glm::vec3(plane));
+		m_Stats = AnimationLodStats();
+	}
+
+	bool isVisible(const glm::vec3& center, float radius) const
+	{
+		for (const glm::vec4& plane : m_Planes)
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+				return false;
+		return true;
+	}
+
+	/**
+	 * @brief The level for a character bounded by the given sphere.
+	 */
+	const AnimationLodLevel& select(const glm::vec3& center, float radius, bool& visible) const
+	{
+		visible = isVisible(center, radius);
+		if (!visible)
+			return m_Settings.offscreen;
+		float distance = std::max(glm::length(center - m_CameraPosition) - radius, 0.0f);
+		for (const AnimationLodLevel& level : m_Settings.levels)
+			if (distance < level.maxDistance)
+				return level;
+		return m_Settings.levels.back();
+	}
+
+	AnimationLodSettings& getSettings() { return m_Settings; }
+	const AnimationLodStats& getFrameStats() const { return m_Stats; }
+	AnimationLodStats& getFrameStats() { return m_Stats; }
+
+private:
+	AnimationLodSettings m_Settings;
+	AnimationLodStats m_Stats;
+	glm::vec3 m_CameraPosition = glm::vec3(0.0f);
+	glm::vec4 m_Planes[6] = {};
+};
+
+/**
+ * @brief Drives one SkeletalAnimator at the rate its AnimationLodPolicy picks. Skipped frames bank
+ * their time for the next update, and show the last two computed palettes blended by the time since
+ * the latest one, which trails the animation by one update in exchange for smooth motion.
+ */
+class AnimationLod
+{
+public:
+	AnimationLod(AnimationLodPolicy* policy, SkeletalAnimator* animator)
+		: m_Policy(policy), m_Animator(animator)
+	{
+	}
+
+	/**
+	 * @brief Advances the animator by dt, or skips it, for a character bounded by the given sphere.
+	 * @return the palette to draw with, valid until the next update().
+	 */
+	const std::vector<glm::mat4>& update(float dt, const glm::vec3& center, float radius)
+	{
+		AnimationLodStats& stats = m_Policy->getFrameStats();
+		bool visible;
+		const AnimationLodLevel& level = m_Policy->select(center, radius, visible);
+		float interval = level.updatesPerSecond > 0.0f ? 1.0f / level.updatesPerSecond : 0.0f;
+		stats.characters++;
+		if (!visible)
+			stats.offscreen++;
+
+		m_Pending += dt;
+		m_SinceUpdate += dt;
+		if (m_Latest.empty() || m_Pending >= interval)
+		{
+			m_Animator->UpdateAnimation(m_Pending, level.maxBoneDepth);
+			std::swap(m_Previous, m_Latest);
+			m_Latest = m_Animator->GetFinalBoneMatrices();
+			if (m_Previous.size() != m_Latest.size())
+				m_Previous = m_Latest;
+			m_Span = m_SinceUpdate;
+			m_Pending = 0.0f;
+			m_SinceUpdate = 0.0f;
+			stats.updates++;
+			if (level.maxBoneDepth != INT_MAX && !m_Animator->usesPoseCache())
+				stats.prunedBones += m_Animator->getCurrentAnimation()->CountPrunedBones(level.maxBoneDepth);
+			m_Version++;
+			if (interval == 0.0f)
+				return m_Latest;
+		}
+		else
+		{
+			stats.skippedUpdates++;
+		}
+
+		if (!m_Policy->getSettings().interpolate || m_Span <= 0.0f)
+			return m_Latest;
+		float alpha = std::min(m_SinceUpdate / m_Span, 1.0f);
+		m_Blended.resize(m_Latest.size());
+		for (size_t i = 0; i < m_Latest.size(); i++)
+			m_Blended[i] = m_Previous[i] + (m_Latest[i] - m_Previous[i]) * alpha;
+		stats.interpolatedPalettes++;
+		m_Version++;
+		return m_Blended;
+	}
+
+	/*changes whenever the palette returned by update() does (see SkeletalAnimator::GetPaletteVersion)*/
+	uint64_t getPaletteVersion() const { return m_Version; }
+
+private:
+	AnimationLodPolicy* m_Policy;
+	SkeletalAnimator* m_Animator;
+	std::vector<glm::mat4> m_Previous;
+	std::vector<glm::mat4> m_Latest;
+	std::vector<glm::mat4> m_Blended;
+	/*time not yet given to the animator*/
+	float m_Pending = 0.0f;
+	float m_SinceUpdate = 0.0f;
+	/*time between the previous and the latest update*/
+	float m_Span = 0.0f;
+	uint64_t m_Version = 0;
+};
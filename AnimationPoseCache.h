@@ -0,0 +1,123 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "SkeletalAnimation.h"
+#include "SkeletalPose.h"
+
+/**
+ * @brief Shares computed palettes between characters that play the same clip at the same time.
+ * Times are quantized to a fixed rate, so instances at identical or nearby phases (a crowd dancing in
+ * sync) land on the same entry, which is sampled and composed once per frame and handed out read-only.
+ * Entries not requested during a frame are dropped at the next beginFrame(); holders of an entry share
+ * ownership of it, so dropping it only releases the cache's reference.
+ */
+class AnimationPoseCache
+{
+public:
+	/**
+	 * @param samplesPerSecond the rate times are quantized to; higher is smoother but shares less.
+	 */
+	AnimationPoseCache(float samplesPerSecond = 60.0f)
+		: m_SamplesPerSecond(samplesPerSecond)
+	{
+	}
+
+	/*a pose and the final bone matrices composed from it*/
+	struct Entry
+	{
+		SkeletalPose pose;
+		std::vector<glm::mat4> palette;
+	};
+
+	/*starts a new frame: evicts entries unused in the previous one and resets the per-frame counters*/
+	void beginFrame()
+	{
+		m_Frame++;
+		for (auto it = m_Entries.begin(); it != m_Entries.end();) {
+			if (it->second.lastFrame + 1 < m_Frame)
+				it = m_Entries.erase(it);
+			else
+				++it;
+		}
+		m_FrameHits = 0;
+		m_FrameMisses = 0;
+	}
+
+	/**
+	 * @brief Gets the pose and final bone matrices of clip at animationTime (in ticks), computing them on
+	 * a miss. The same entry is returned to every request for the same clip and quantized time.
+	 */
+	std::shared_ptr<const Entry> get(SkeletalAnimation* clip, float animationTime)
+	{
+		float samplesPerTick = m_SamplesPerSecond / clip->GetTicksPerSecond();
+		Key key = { clip, (int64_t)std::llround(animationTime * samplesPerTick) };
+
+		Slot& slot = m_Entries[key];
+		slot.lastFrame = m_Frame;
+		if (slot.entry) {
+			m_FrameHits++;
+			m_TotalHits++;
+			return slot.entry;
+		}
+
+		// Every instance sharing the entry sees the pose at the quantized time itself.
+		float time = std::min(key.sample / samplesPerTick, std::nextafter(clip->GetDuration(), 0.0f));
+		auto entry = std::make_shared<Entry>();
+		entry->palette.assign(clip->getBonesSize(), glm::mat4(1.0f));
+		clip->SamplePose(time, entry->pose);
+		clip->ComposePose(entry->pose, entry->palette);
+		slot.entry = entry;
+		m_FrameMisses++;
+		m_TotalMisses++;
+		return slot.entry;
+	}
+
+	uint64_t getFrameHits() const { return m_FrameHits; }
+	uint64_t getFrameMisses() const { return m_FrameMisses; }
+	uint64_t getTotalHits() const { return m_TotalHits; }
+	uint64_t getTotalMisses() const { return m_TotalMisses; }
+	size_t getEntryCount() const { return m_Entries.size(); }
+
+	/*the fraction of requests served without computing, since the cache was created*/
+	float getHitRate() const
+	{
+		uint64_t total = m_TotalHits + m_TotalMisses;
+		return total == 0 ? 0.0f : float(m_TotalHits) / total;
+	}
+
+private:
+	struct Key
+	{
+		const SkeletalAnimation* clip;
+		int64_t sample;
+		bool operator==(const Key& other) const { return clip == other.clip && sample == other.sample; }
+	};
+
+	struct KeyHash
+	{
+		size_t operator()(const Key& key) const
+		{
+			return std::hash<const void*>()(key.clip) ^ (std::hash<int64_t>()(key.sample) * 0x9e3779b97f4a7c15ull);
+		}
+	};
+
+	struct Slot
+	{
+		std::shared_ptr<const Entry> entry;
+		uint64_t lastFrame = 0;
+	};
+
+	std::unordered_map<Key, Slot, KeyHash> m_Entries;
+	float m_SamplesPerSecond;
+	uint64_t m_Frame = 1;
+	uint64_t m_FrameHits = 0;
+	uint64_t m_FrameMisses = 0;
+	uint64_t m_TotalHits = 0;
+	uint64_t m_TotalMisses = 0;
+};
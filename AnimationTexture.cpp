@@ -0,0 +1,45 @@
+#include "AnimationTexture.h"
+#include "SkeletalAnimation.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <glad/glad.h>
+
+AnimationTexture::AnimationTexture(SkeletalAnimation& clip, float framesPerSecond) {
+	float seconds = clip.GetDuration() / clip.GetTicksPerSecond();
+	m_boneCount = clip.getBonesSize();
+	m_frameCount = std::max(1, (int)std::lround(seconds * framesPerSecond));
+	m_framesPerSecond = m_frameCount / seconds;
+
+	std::vector<glm::vec4> texels((size_t)m_boneCount * 4 * m_frameCount);
+	std::vector<glm::mat4> palette(m_boneCount, glm::mat4(1.0f));
+	SkeletalPose pose;
+	for (int frame = 0; frame < m_frameCount; frame++) {
+		clip.SamplePose(clip.GetDuration() * frame / m_frameCount, pose);
+		clip.ComposePose(pose, palette);
+		glm::vec4* row = &texels[(size_t)frame * m_boneCount * 4];
+		for (int bone = 0; bone < m_boneCount; bone++) {
+			for (int column = 0; column < 4; column++) {
+				row[bone * 4 + column] = palette[bone][column];
+			}
+		}
+	}
+
+	// Texels are fetched exactly, so no filtering or mipmaps.
+	glGenTextures(1, &m_texture);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_boneCount * 4, m_frameCount, 0, GL_RGBA, GL_FLOAT, texels.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void AnimationTexture::bind(ShaderProgram& program, int unit) const {
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(GL_TEXTURE_2D, m_texture);
+	program.setUniform("animationTexture", unit);
+	program.setUniform("animationFrames", m_frameCount);
+	program.setUniform("animationFramesPerSecond", m_framesPerSecond);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "ShaderProgram.h"
+
+class SkeletalAnimation;
+
+/**
+ * @brief A looping clip baked offline into a float texture of bone palettes: one row per frame, four
+ * texels (the matrix columns) per bone. shaders/crowd.vert fetches and blends two rows per vertex, so
+ * any number of instances play the clip with no per-character CPU work.
+ */
+class AnimationTexture {
+private:
+	uint32_t m_texture = 0;
+	int m_boneCount = 0;
+	int m_frameCount = 0;
+	float m_framesPerSecond = 0.0f;
+
+public:
+	/**
+	 * @brief Samples and composes the clip at about framesPerSecond; the rate is adjusted so the frames
+	 * divide the clip evenly and the last frame blends seamlessly into the first.
+	 */
+	AnimationTexture(SkeletalAnimation& clip, float framesPerSecond = 30.0f);
+
+	/**
+	 * @brief Binds the texture to the given unit and sets the animationTexture, animationFrames and
+	 * animationFramesPerSecond uniforms of the program.
+	 */
+	void bind(ShaderProgram& program, int unit) const;
+
+	int getBoneCount() const { return m_boneCount; }
+	int getFrameCount() const { return m_frameCount; }
+	float getFramesPerSecond() const { return m_framesPerSecond; }
+	float getDuration() const { return m_frameCount / m_framesPerSecond; }
+	size_t getByteSize() const { return (size_t)m_boneCount * 4 * m_frameCount * sizeof(glm::vec4); }
+};
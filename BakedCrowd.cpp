@@ -0,0 +1,38 @@
+#include "BakedCrowd.h"
+#include <glad/glad.h>
+
+BakedCrowd::BakedCrowd(SkeletalObject& object, const AnimationTexture& animation)
+	: m_object(object), m_animation(animation) {
+	glGenBuffers(1, &m_instanceVbo);
+	m_object.enableInstancing(m_instanceVbo);
+}
+
+void BakedCrowd::addInstance(const glm::mat4& model, float timeOffset, float timeScale) {
+	m_instances.push_back({ model, timeOffset, timeScale, 0 });
+	m_dirty = true;
+}
+
+void BakedCrowd::clear() {
+	m_instances.clear();
+	m_dirty = true;
+}
+
+void BakedCrowd::render(sf::RenderWindow& window, ShaderProgram& program, float time, int animationUnit) {
+	if (m_dirty) {
+		glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+		glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(SkeletalInstance), m_instances.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		m_uploadedCount = m_instances.size();
+		m_dirty = false;
+	}
+	if (m_uploadedCount == 0) {
+		return;
+	}
+
+	m_animation.bind(program, animationUnit);
+	program.setUniform("animationTime", time);
+	m_object.renderInstanced(window, program, m_uploadedCount);
+	glActiveTexture(GL_TEXTURE0 + animationUnit);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include <glm/glm.hpp>
+#include "SkeletalObject.h"
+#include "AnimationTexture.h"
+#include "ShaderProgram.h"
+
+/**
+ * @brief Many copies of one skeletal model playing a baked clip (see AnimationTexture), drawn with one
+ * instanced call per mesh through shaders/crowd.vert. Instances differ only by placement, time offset
+ * and speed, and cost nothing on the CPU once uploaded.
+ */
+class BakedCrowd {
+private:
+	SkeletalObject& m_object;
+	const AnimationTexture& m_animation;
+	std::vector<SkeletalInstance> m_instances;
+	uint32_t m_instanceVbo = 0;
+	size_t m_uploadedCount = 0;
+	bool m_dirty = false;
+
+public:
+	/**
+	 * @brief The crowd draws the meshes of object, which keep working as an ordinary model.
+	 */
+	BakedCrowd(SkeletalObject& object, const AnimationTexture& animation);
+
+	void addInstance(const glm::mat4& model, float timeOffset, float timeScale = 1.0f);
+	void clear();
+	size_t size() const { return m_instances.size(); }
+
+	/**
+	 * @brief Draws every instance at the given time in seconds, uploading instances added since the last call.
+	 * @param animationUnit a texture unit not used by the meshes' own textures or the program's shadow map.
+	 */
+	void render(sf::RenderWindow& window, ShaderProgram& program, float time, int animationUnit = 5);
+};
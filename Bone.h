@@ -83,7 +83,27 @@ public:
 	}
 	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
 	std::string GetBoneName() const { return m_Name; }
-	int GetBoneID() { return m_ID; }
+	int GetBoneID() const { return m_ID; }
+	void SetBoneID(int id) { m_ID = id; }
+
+	const std::vector<KeyPosition>& GetPositionKeys() const { return m_Positions; }
+	const std::vector<KeyRotation>& GetRotationKeys() const { return m_Rotations; }
+	const std::vector<KeyScale>& GetScaleKeys() const { return m_Scales; }
+
+	/**
+	 * @brief Rewrites every key as its delta against the given local transform, as SkeletalPose::MakeAdditive
+	 * does for poses. Interpolating the deltas gives the delta of the interpolated keys, so sampling stays exact.
+	 */
+	void MakeAdditive(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		glm::quat inverse = glm::inverse(rotation);
+		for (auto& key : m_Positions)
+			key.position -= translation;
+		for (auto& key : m_Rotations)
+			key.orientation = glm::normalize(inverse * key.orientation);
+		for (auto& key : m_Scales)
+			key.scale /= scale;
+	}
 
 
 
@@ -129,27 +149,23 @@ public:
 		return scaleFactor;
 	}
 
-	glm::mat4 InterpolatePosition(float animationTime)
+	glm::vec3 SamplePosition(float animationTime)
 	{
 		if (1 == m_NumPositions)
-			return glm::translate(glm::mat4(1.0f), m_Positions[0].position);
+			return m_Positions[0].position;
 
 		int p0Index = GetPositionIndex(animationTime);
 		int p1Index = p0Index + 1;
 		float scaleFactor = GetScaleFactor(m_Positions[p0Index].timeStamp,
 			m_Positions[p1Index].timeStamp, animationTime);
-		glm::vec3 finalPosition = glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
+		return glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
 			, scaleFactor);
-		return glm::translate(glm::mat4(1.0f), finalPosition);
 	}
 
-	glm::mat4 InterpolateRotation(float animationTime)
+	glm::quat SampleRotation(float animationTime)
 	{
 		if (1 == m_NumRotations)
-		{
-			auto rotation = glm::normalize(m_Rotations[0].orientation);
-			return glm::toMat4(rotation);
-		}
+			return glm::normalize(m_Rotations[0].orientation);
 
 		int p0Index = GetRotationIndex(animationTime);
 		int p1Index = p0Index + 1;
@@ -157,44 +173,40 @@ public:
 			m_Rotations[p1Index].timeStamp, animationTime);
 		glm::quat finalRotation = glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p1Index].orientation
 			, scaleFactor);
-		finalRotation = glm::normalize(finalRotation);
-		return glm::toMat4(finalRotation);
-
+		return glm::normalize(finalRotation);
 	}
 
-	glm::mat4 InterpolateScaling(float animationTime)
+	glm::vec3 SampleScale(float animationTime)
 	{
 		if (1 == m_NumScalings)
-			return glm::scale(glm::mat4(1.0f), m_Scales[0].scale);
+			return m_Scales[0].scale;
 
 		int p0Index = GetScaleIndex(animationTime);
 		int p1Index = p0Index + 1;
 		float scaleFactor = GetScaleFactor(m_Scales[p0Index].timeStamp,
 			m_Scales[p1Index].timeStamp, animationTime);
-		glm::vec3 finalScale = glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
+		return glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
 			, scaleFactor);
-		return glm::scale(glm::mat4(1.0f), finalScale);
 	}
 
+	glm::mat4 InterpolatePosition(float animationTime)
+	{
+		return glm::translate(glm::mat4(1.0f), SamplePosition(animationTime));
+	}
 
+	glm::mat4 InterpolateRotation(float animationTime)
+	{
+		return glm::toMat4(SampleRotation(animationTime));
+	}
 
-
+	glm::mat4 InterpolateScaling(float animationTime)
+	{
+		return glm::scale(glm::mat4(1.0f), SampleScale(animationTime));
+	}
 
 	glm::quat quat_InterpolateRotation(float animationTime)
 	{
-		if (1 == m_NumRotations)
-		{
-			auto rotation = glm::normalize(m_Rotations[0].orientation);
-			return glm::toMat4(rotation);
-		}
-		int p0Index = GetRotationIndex(animationTime);
-		int p1Index = p0Index + 1;
-		float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp,
-			m_Rotations[p1Index].timeStamp, animationTime);
-		glm::quat finalRotation = glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p1Index].orientation
-			, scaleFactor);
-		finalRotation = glm::normalize(finalRotation);
-		return finalRotation;
+		return SampleRotation(animationTime);
 	}
 
 
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+/**
+ * @brief A weight per bone id for a partial-body layer (see SkeletalAnimator::addLayer). Bones outside
+ * the mask have weight 0 and are neither sampled nor touched by the layer.
+ */
+class BoneMask
+{
+public:
+	BoneMask() = default;
+
+	void Set(int bone, float weight)
+	{
+		if (bone < 0)
+			return;
+		if (bone >= (int)m_Weights.size())
+			m_Weights.resize(bone + 1, 0.0f);
+		m_Weights[bone] = weight;
+	}
+
+	float GetWeight(int bone) const
+	{
+		return bone >= 0 && bone < (int)m_Weights.size() ? m_Weights[bone] : 0.0f;
+	}
+
+	bool Contains(int bone) const { return GetWeight(bone) > 0.0f; }
+
+	/*the number of bones with a weight*/
+	int GetBoneCount() const
+	{
+		int count = 0;
+		for (float weight : m_Weights)
+			if (weight > 0.0f)
+				count++;
+		return count;
+	}
+
+private:
+	std::vector<float> m_Weights;
+};
@@ -0,0 +1,239 @@
+#include "CpuSkinning.h"
+#include "ParallelFor.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#if defined(__AVX__)
+#define CPU_SKINNING_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPU_SKINNING_SSE
+#include <emmintrin.h>
+#endif
+
+// Vertex ranges smaller than this are not worth a thread.
+const size_t MIN_VERTICES_PER_THREAD = 2048;
+
+CpuSkinning::Kernel CpuSkinning::BestKernel() {
+#if defined(CPU_SKINNING_AVX)
+	return Kernel::AVX;
+#elif defined(CPU_SKINNING_SSE)
+	return Kernel::SSE;
+#else
+	return Kernel::Scalar;
+#endif
+}
+
+const char* CpuSkinning::KernelName(Kernel kernel) {
+	switch (kernel) {
+	case Kernel::AVX: return "AVX";
+	case Kernel::SSE: return "SSE";
+	default: return "scalar";
+	}
+}
+
+void CpuSkinning::SkinScalar(const SkeletalVertex* in, SkinnedVertex* out, size_t count,
+	const glm::mat4* palette, size_t paletteSize) {
+	for (size_t v = 0; v < count; v++) {
+		const SkeletalVertex& vertex = in[v];
+		glm::mat4 boneTransform(0.0f);
+		for (int i = 0; i < MAX_BONE_PER_VERTEX; i++) {
+			int id = vertex.m_BoneIDs[i];
+			if (id < 0)
+				break;
+			if (id >= (int)paletteSize)
+				continue;
+			boneTransform += palette[id] * vertex.m_Weights[i];
+		}
+		glm::mat3 boneRotation(boneTransform);
+		out[v].Position = glm::vec3(boneTransform * glm::vec4(vertex.Position, 1.0f));
+		out[v].Normal = glm::normalize(boneRotation * vertex.Normal);
+		out[v].Tangent = glm::normalize(boneRotation * vertex.Tangent);
+	}
+}
+
+#if defined(CPU_SKINNING_SSE) || defined(CPU_SKINNING_AVX)
+
+static inline __m128 normalize3(__m128 v) {
+	__m128 square = _mm_mul_ps(v, v);
+	__m128 sum = _mm_add_ps(square, _mm_shuffle_ps(square, square, _MM_SHUFFLE(2, 3, 0, 1)));
+	sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_div_ps(v, _mm_sqrt_ps(_mm_max_ps(sum, _mm_set1_ps(1e-30f))));
+}
+
+static inline void store3(glm::vec3& dest, __m128 v) {
+	alignas(16) float tmp[4];
+	_mm_store_ps(tmp, v);
+	dest = glm::vec3(tmp[0], tmp[1], tmp[2]);
+}
+
+/**
+ * @brief Transforms one vertex by the blended bone matrix, given as four columns.
+ */
+static inline void transformVertex(const SkeletalVertex& vertex, SkinnedVertex& out,
+	__m128 c0, __m128 c1, __m128 c2, __m128 c3) {
+	// Zero the w lane, so normals and tangents normalize over xyz only.
+	const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+
+	__m128 position = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(vertex.Position.x)), _mm_mul_ps(c1, _mm_set1_ps(vertex.Position.y))),
+		_mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(vertex.Position.z)), c3));
+	__m128 normal = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(vertex.Normal.x)), _mm_mul_ps(c1, _mm_set1_ps(vertex.Normal.y))),
+		_mm_mul_ps(c2, _mm_set1_ps(vertex.Normal.z)));
+	__m128 tangent = _mm_add_ps(
+		_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(vertex.Tangent.x)), _mm_mul_ps(c1, _mm_set1_ps(vertex.Tangent.y))),
+		_mm_mul_ps(c2, _mm_set1_ps(vertex.Tangent.z)));
+
+	store3(out.Position, position);
+	store3(out.Normal, normalize3(_mm_and_ps(normal, xyzMask)));
+	store3(out.Tangent, normalize3(_mm_and_ps(tangent, xyzMask)));
+}
+
+#endif
+
+void CpuSkinning::SkinSimd(const SkeletalVertex* in, SkinnedVertex* out, size_t count,
+	const glm::mat4* palette, size_t paletteSize) {
+#if defined(CPU_SKINNING_AVX)
+	// glm matrices are column-major, so each pair of columns is one 256-bit load.
+	for (size_t v = 0; v < count; v++) {
+		const SkeletalVertex& vertex = in[v];
+		__m256 c01 = _mm256_setzero_ps();
+		__m256 c23 = _mm256_setzero_ps();
+		for (int i = 0; i < MAX_BONE_PER_VERTEX; i++) {
+			int id = vertex.m_BoneIDs[i];
+			if (id < 0)
+				break;
+			if (id >= (int)paletteSize)
+				continue;
+			const float* m = &palette[id][0][0];
+			__m256 weight = _mm256_set1_ps(vertex.m_Weights[i]);
+#if defined(__FMA__)
+			c01 = _mm256_fmadd_ps(_mm256_loadu_ps(m), weight, c01);
+			c23 = _mm256_fmadd_ps(_mm256_loadu_ps(m + 8), weight, c23);
+#else
+			c01 = _mm256_add_ps(c01, _mm256_mul_ps(_mm256_loadu_ps(m), weight));
+			c23 = _mm256_add_ps(c23, _mm256_mul_ps(_mm256_loadu_ps(m + 8), weight));
+#endif
+		}
+		transformVertex(vertex, out[v],
+			_mm256_castps256_ps128(c01), _mm256_extractf128_ps(c01, 1),
+			_mm256_castps256_ps128(c23), _mm256_extractf128_ps(c23, 1));
+	}
+#elif defined(CPU_SKINNING_SSE)
+	for (size_t v = 0; v < count; v++) {
+		const SkeletalVertex& vertex = in[v];
+		__m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+		for (int i = 0; i < MAX_BONE_PER_VERTEX; i++) {
+			int id = vertex.m_BoneIDs[i];
+			if (id < 0)
+				break;
+			if (id >= (int)paletteSize)
+				continue;
+			const float* m = &palette[id][0][0];
+			__m128 weight = _mm_set1_ps(vertex.m_Weights[i]);
+			c0 = _mm_add_ps(c0, _mm_mul_ps(_mm_loadu_ps(m), weight));
+			c1 = _mm_add_ps(c1, _mm_mul_ps(_mm_loadu_ps(m + 4), weight));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(_mm_loadu_ps(m + 8), weight));
+			c3 = _mm_add_ps(c3, _mm_mul_ps(_mm_loadu_ps(m + 12), weight));
+		}
+		transformVertex(vertex, out[v], c0, c1, c2, c3);
+	}
+#else
+	SkinScalar(in, out, count, palette, paletteSize);
+#endif
+}
+
+void CpuSkinning::Skin(const std::vector<SkeletalVertex>& in, std::vector<SkinnedVertex>& out,
+	const std::vector<glm::mat4>& palette, unsigned maxThreads) {
+	out.resize(in.size());
+	parallelFor(in.size(), MIN_VERTICES_PER_THREAD, [&](size_t begin, size_t end) {
+		SkinSimd(in.data() + begin, out.data() + begin, end - begin, palette.data(), palette.size());
+	}, maxThreads);
+}
+
+void CpuSkinning::ComputeBounds(const std::vector<SkinnedVertex>& vertices, glm::vec3& min, glm::vec3& max) {
+	min = glm::vec3(std::numeric_limits<float>::max());
+	max = glm::vec3(-std::numeric_limits<float>::max());
+	for (auto& vertex : vertices) {
+		min = glm::min(min, vertex.Position);
+		max = glm::max(max, vertex.Position);
+	}
+}
+
+bool CpuSkinning::Raycast(const std::vector<SkinnedVertex>& vertices, const std::vector<uint32_t>& faces,
+	const glm::vec3& origin, const glm::vec3& direction, float& distance) {
+	// Moller-Trumbore, keeping the nearest hit in front of the origin.
+	bool hit = false;
+	float nearest = std::numeric_limits<float>::max();
+	for (size_t i = 0; i + 2 < faces.size(); i += 3) {
+		const glm::vec3& p0 = vertices[faces[i]].Position;
+		const glm::vec3& p1 = vertices[faces[i + 1]].Position;
+		const glm::vec3& p2 = vertices[faces[i + 2]].Position;
+		glm::vec3 edge1 = p1 - p0;
+		glm::vec3 edge2 = p2 - p0;
+		glm::vec3 p = glm::cross(direction, edge2);
+		float det = glm::dot(edge1, p);
+		if (std::abs(det) < 1e-12f)
+			continue;
+		float invDet = 1.0f / det;
+		glm::vec3 s = origin - p0;
+		float u = glm::dot(s, p) * invDet;
+		if (u < 0.0f || u > 1.0f)
+			continue;
+		glm::vec3 q = glm::cross(s, edge1);
+		float v = glm::dot(direction, q) * invDet;
+		if (v < 0.0f || u + v > 1.0f)
+			continue;
+		float t = glm::dot(edge2, q) * invDet;
+		if (t > 0.0f && t < nearest) {
+			nearest = t;
+			hit = true;
+		}
+	}
+	if (hit) {
+		distance = nearest;
+	}
+	return hit;
+}
+
+void CpuSkinning::Benchmark(const std::vector<SkeletalVertex>& vertices, const std::vector<glm::mat4>& palette,
+	int iterations) {
+	using clock = std::chrono::high_resolution_clock;
+	std::vector<SkinnedVertex> reference(vertices.size());
+	std::vector<SkinnedVertex> simd(vertices.size());
+	std::vector<SkinnedVertex> threaded;
+
+	auto time = [iterations](auto&& run) {
+		auto start = clock::now();
+		for (int i = 0; i < iterations; i++) {
+			run();
+		}
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count() / iterations;
+	};
+
+	double scalarMs = time([&]() {
+		SkinScalar(vertices.data(), reference.data(), vertices.size(), palette.data(), palette.size());
+	});
+	double simdMs = time([&]() {
+		SkinSimd(vertices.data(), simd.data(), vertices.size(), palette.data(), palette.size());
+	});
+	double threadedMs = time([&]() {
+		Skin(vertices, threaded, palette);
+	});
+
+	float maxError = 0.0f;
+	for (size_t i = 0; i < vertices.size(); i++) {
+		glm::vec3 d = glm::abs(reference[i].Position - simd[i].Position);
+		maxError = std::max(maxError, std::max(d.x, std::max(d.y, d.z)));
+	}
+
+	std::cout << "CPU skinning, " << vertices.size() << " vertices, " << iterations << " iterations\n"
+		<< "  scalar: " << scalarMs << " ms\n"
+		<< "  " << KernelName(BestKernel()) << ": " << simdMs << " ms (" << scalarMs / simdMs << "x)\n"
+		<< "  " << KernelName(BestKernel()) << ", " << parallelForThreads(vertices.size(), MIN_VERTICES_PER_THREAD)
+		<< " threads: " << threadedMs << " ms (" << scalarMs / threadedMs << "x)\n"
+		<< "  max position error vs scalar: " << maxError << "\n";
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "SkeletalMesh.h"
+
+/**
+ * @brief Skins SkeletalVertex data on the CPU, for machines whose GL driver skins slowly or not at all
+ * (software GL on CI and render-farm machines), and for CPU-side queries such as bounds and picking.
+ * Results use the same SkinnedVertex layout as the transform-feedback pre-skinning pass, so they can be
+ * uploaded with SkeletalMesh::uploadSkinned() and drawn as a static mesh.
+ */
+class CpuSkinning
+{
+public:
+	enum class Kernel { Scalar, SSE, AVX };
+
+	/**
+	 * @brief The fastest kernel this build was compiled with.
+	 */
+	static Kernel BestKernel();
+	static const char* KernelName(Kernel kernel);
+
+	/**
+	 * @brief Reference implementation with glm, identical in math to shaders/skinning.vert.
+	 */
+	static void SkinScalar(const SkeletalVertex* in, SkinnedVertex* out, size_t count,
+		const glm::mat4* palette, size_t paletteSize);
+
+	/**
+	 * @brief Skins with the SSE or AVX kernel, falling back to SkinScalar when neither is available.
+	 */
+	static void SkinSimd(const SkeletalVertex* in, SkinnedVertex* out, size_t count,
+		const glm::mat4* palette, size_t paletteSize);
+
+	/**
+	 * @brief Skins all vertices with SkinSimd, split into vertex ranges over worker threads.
+	 * @param maxThreads 0 means one thread per hardware thread.
+	 */
+	static void Skin(const std::vector<SkeletalVertex>& in, std::vector<SkinnedVertex>& out,
+		const std::vector<glm::mat4>& palette, unsigned maxThreads = 0);
+
+	/**
+	 * @brief Axis-aligned bounds of skinned positions, in mesh space.
+	 */
+	static void ComputeBounds(const std::vector<SkinnedVertex>& vertices, glm::vec3& min, glm::vec3& max);
+
+	/**
+	 * @brief Intersects a ray with the skinned triangles, in mesh space.
+	 * @param distance receives the ray parameter of the nearest hit, in units of direction.
+	 * @return whether any triangle was hit.
+	 */
+	static bool Raycast(const std::vector<SkinnedVertex>& vertices, const std::vector<uint32_t>& faces,
+		const glm::vec3& origin, const glm::vec3& direction, float& distance);
+
+	/**
+	 * @brief Times the scalar, SIMD and threaded paths on the given vertices, and prints the timings
+	 * together with the largest difference between the SIMD and scalar results.
+	 */
+	static void Benchmark(const std::vector<SkeletalVertex>& vertices, const std::vector<glm::mat4>& palette,
+		int iterations = 100);
+};
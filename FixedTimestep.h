@@ -0,0 +1,124 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+/**
+ * @brief Runs a simulation in steps of a fixed length however fast frames render (Fiedler, "Fix Your
+ * Timestep!"). Frame time is banked in an accumulator and spent in whole steps; the remainder says how
+ * far the rendered frame lies between the last two steps, for interpolating what is drawn.
+ */
+class FixedTimestep
+{
+public:
+	/**
+	 * @param maxStepsPerFrame frames longer than this many steps drop the excess time, so a slow frame
+	 * cannot make the next one slower still.
+	 */
+	FixedTimestep(float stepsPerSecond = 60.0f, int maxStepsPerFrame = 8)
+		: m_Step(1.0f / stepsPerSecond), m_MaxStepsPerFrame(maxStepsPerFrame)
+	{
+	}
+
+	/**
+	 * @brief Banks a frame's time. The very first frame always runs a step, so there is a state to render.
+	 * @return the number of steps to run this frame.
+	 */
+	int advance(float frameSeconds)
+	{
+		m_Accumulator += frameSeconds;
+		if (m_StepCount == 0)
+			m_Accumulator = std::max(m_Accumulator, m_Step);
+		int steps = std::min((int)(m_Accumulator / m_Step), m_MaxStepsPerFrame);
+		m_Accumulator -= steps * m_Step;
+		if (steps == m_MaxStepsPerFrame)
+			m_Accumulator = std::min(m_Accumulator, m_Step);
+		m_StepCount += steps;
+		return steps;
+	}
+
+	/*the length of a step, in seconds*/
+	float getStep() const { return m_Step; }
+
+	/*how far the frame is from the last step toward the next one, in [0, 1]*/
+	float getAlpha() const { return std::min(m_Accumulator / m_Step, 1.0f); }
+
+	uint64_t getStepCount() const { return m_StepCount; }
+
+private:
+	float m_Step;
+	int m_MaxStepsPerFrame;
+	float m_Accumulator = 0.0f;
+	uint64_t m_StepCount = 0;
+};
+
+/**
+ * @brief The palettes of the last two simulation steps, blended for the frame being rendered.
+ */
+class InterpolatedPalette
+{
+public:
+	/*records the palette of a step; version is the producer's palette version, so unchanged palettes are not copied*/
+	void push(const std::vector<glm::mat4>& palette, uint64_t version)
+	{
+		if (!m_Latest.empty() && version == m_LatestVersion)
+		{
+			// Held for a step: the previous state equals the latest.
+			if (m_PreviousVersion != m_LatestVersion)
+			{
+				m_Previous = m_Latest;
+				m_PreviousVersion = m_LatestVersion;
+			}
+			return;
+		}
+		std::swap(m_Previous, m_Latest);
+		m_PreviousVersion = m_LatestVersion;
+		m_Latest = palette;
+		m_LatestVersion = version;
+		if (m_Previous.size() != m_Latest.size())
+		{
+			m_Previous = m_Latest;
+			m_PreviousVersion = m_LatestVersion;
+		}
+	}
+
+	/**
+	 * @brief The palette alpha of the way from the previous step to the latest, valid until the next call.
+	 */
+	const std::vector<glm::mat4>& get(float alpha)
+	{
+		if (m_PreviousVersion == m_LatestVersion)
+		{
+			Publish(m_LatestVersion, 1.0f);
+			return m_Latest;
+		}
+		m_Blended.resize(m_Latest.size());
+		for (size_t i = 0; i < m_Latest.size(); i++)
+			m_Blended[i] = m_Previous[i] + (m_Latest[i] - m_Previous[i]) * alpha;
+		Publish(m_LatestVersion, alpha);
+		return m_Blended;
+	}
+
+	/*changes whenever the palette returned by get() does (see SkeletalAnimator::GetPaletteVersion)*/
+	uint64_t getVersion() const { return m_Version; }
+
+private:
+	void Publish(uint64_t source, float alpha)
+	{
+		if (source != m_PublishedSource || alpha != m_PublishedAlpha)
+			m_Version++;
+		m_PublishedSource = source;
+		m_PublishedAlpha = alpha;
+	}
+
+	std::vector<glm::mat4> m_Previous;
+	std::vector<glm::mat4> m_Latest;
+	std::vector<glm::mat4> m_Blended;
+	uint64_t m_PreviousVersion = 0;
+	uint64_t m_LatestVersion = 0;
+	uint64_t m_PublishedSource = ~uint64_t(0);
+	float m_PublishedAlpha = -1.0f;
+	uint64_t m_Version = 0;
+};
@@ -0,0 +1,165 @@
+#include "HierarchyCompose.h"
+#include "SkeletalAnimation.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined(__AVX__)
+#define HIERARCHY_COMPOSE_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HIERARCHY_COMPOSE_SSE
+#include <emmintrin.h>
+#endif
+
+void HierarchyCompose::Multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+	const float* pa = &a[0][0];
+	const float* pb = &b[0][0];
+	float* po = &out[0][0];
+#if defined(HIERARCHY_COMPOSE_AVX)
+	// Both halves hold the same column of a; each half builds one column of the result.
+	__m256 a0 = _mm256_broadcast_ps((const __m128*)pa);
+	__m256 a1 = _mm256_broadcast_ps((const __m128*)(pa + 4));
+	__m256 a2 = _mm256_broadcast_ps((const __m128*)(pa + 8));
+	__m256 a3 = _mm256_broadcast_ps((const __m128*)(pa + 12));
+	__m256 b01 = _mm256_loadu_ps(pb);
+	__m256 b23 = _mm256_loadu_ps(pb + 8);
+	auto column = [&](__m256 bColumns) {
+		__m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bColumns, _MM_SHUFFLE(0, 0, 0, 0)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bColumns, _MM_SHUFFLE(1, 1, 1, 1))));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bColumns, _MM_SHUFFLE(2, 2, 2, 2))));
+		return _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bColumns, _MM_SHUFFLE(3, 3, 3, 3))));
+	};
+	__m256 r01 = column(b01);
+	__m256 r23 = column(b23);
+	_mm256_storeu_ps(po, r01);
+	_mm256_storeu_ps(po + 8, r23);
+#elif defined(HIERARCHY_COMPOSE_SSE)
+	__m128 a0 = _mm_loadu_ps(pa);
+	__m128 a1 = _mm_loadu_ps(pa + 4);
+	__m128 a2 = _mm_loadu_ps(pa + 8);
+	__m128 a3 = _mm_loadu_ps(pa + 12);
+	__m128 r[4];
+	for (int j = 0; j < 4; j++) {
+		r[j] = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(pb[4 * j])), _mm_mul_ps(a1, _mm_set1_ps(pb[4 * j + 1]))),
+			_mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(pb[4 * j + 2])), _mm_mul_ps(a3, _mm_set1_ps(pb[4 * j + 3]))));
+	}
+	for (int j = 0; j < 4; j++) {
+		_mm_storeu_ps(po + 4 * j, r[j]);
+	}
+#else
+	out = a * b;
+#endif
+}
+
+std::vector<HierarchyNode> HierarchyCompose::Bake(const std::vector<HierarchyNode>& nodes, int boneCount) {
+	size_t count = nodes.size();
+	std::vector<bool> isBone(count), hasBone(count);
+	for (size_t i = count; i-- > 0;) {
+		isBone[i] = nodes[i].bone >= 0 && nodes[i].bone < boneCount;
+		hasBone[i] = hasBone[i] || isBone[i];
+		if (nodes[i].parent >= 0 && hasBone[i]) {
+			hasBone[nodes[i].parent] = true;
+		}
+	}
+
+	// For a folded node: the baked index of its nearest bone ancestor, and the product of the folded
+	// nodes from there down to and including itself. For a bone: its own baked index.
+	std::vector<int> anchor(count, -1);
+	std::vector<glm::mat4> folded(count);
+	std::vector<bool> hasFolded(count, false);
+	std::vector<HierarchyNode> baked;
+	const glm::mat4 identity(1.0f);
+	for (size_t i = 0; i < count; i++) {
+		if (!hasBone[i]) {
+			continue;
+		}
+		const HierarchyNode& node = nodes[i];
+		int up = -1;
+		const glm::mat4* above = nullptr;
+		if (node.parent >= 0) {
+			up = anchor[node.parent];
+			if (!isBone[node.parent] && hasFolded[node.parent]) {
+				above = &folded[node.parent];
+			}
+		}
+
+		if (isBone[i]) {
+			HierarchyNode bone = node;
+			bone.parent = up;
+			bone.prefix = above ? *above : identity;
+			bone.hasPrefix = above != nullptr;
+			anchor[i] = (int)baked.size();
+			baked.push_back(bone);
+		}
+		else {
+			anchor[i] = up;
+			folded[i] = above ? *above * node.transformation : node.transformation;
+			hasFolded[i] = folded[i] != identity;
+		}
+	}
+	return baked;
+}
+
+void HierarchyCompose::Compose(const std::vector<HierarchyNode>& nodes, const glm::mat4& globalInverseTransform,
+	const SkeletalPose& pose, std::vector<glm::mat4>& globals, std::vector<glm::mat4>& finalBoneMatrices,
+	int maxBoneDepth) {
+	globals.resize(nodes.size());
+	maxBoneDepth = std::max(maxBoneDepth, 1);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		const HierarchyNode& node = nodes[i];
+		if (node.boneDepth > maxBoneDepth) {
+			// Everything below a pruned bone is pruned too, so its global transform is never needed.
+			if (node.bone >= 0 && node.bone < (int)finalBoneMatrices.size()
+				&& node.parentBone >= 0 && node.parentBone < (int)finalBoneMatrices.size())
+				finalBoneMatrices[node.bone] = finalBoneMatrices[node.parentBone];
+			continue;
+		}
+		bool isBone = node.bone >= 0 && node.bone < (int)pose.size() && node.bone < (int)finalBoneMatrices.size();
+		// globals hold globalInverse * global, so a bone's final matrix is a single product with its offset.
+		const glm::mat4& parent = node.parent < 0 ? globalInverseTransform : globals[node.parent];
+		if (isBone) {
+			const glm::mat4* base = &parent;
+			if (node.hasPrefix) {
+				Multiply(parent, node.prefix, globals[i]);
+				base = &globals[i];
+			}
+			Multiply(*base, LocalTransform(pose.translations[node.bone], pose.rotations[node.bone], pose.scales[node.bone]), globals[i]);
+			Multiply(globals[i], node.offset, finalBoneMatrices[node.bone]);
+		}
+		else {
+			Multiply(parent, node.transformation, globals[i]);
+		}
+	}
+}
+
+void HierarchyCompose::Benchmark(SkeletalAnimation& animation, const SkeletalPose& pose, int iterations) {
+	using clock = std::chrono::high_resolution_clock;
+	std::vector<glm::mat4> reference(animation.getBonesSize(), glm::mat4(1.0f));
+	std::vector<glm::mat4> flat(animation.getBonesSize(), glm::mat4(1.0f));
+
+	auto time = [iterations](auto&& run) {
+		auto start = clock::now();
+		for (int i = 0; i < iterations; i++) {
+			run();
+		}
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count() / iterations;
+	};
+	double recursiveMs = time([&]() { animation.ComposePoseRecursive(pose, reference); });
+	double flatMs = time([&]() { animation.ComposePose(pose, flat); });
+
+	float maxError = 0.0f;
+	for (size_t i = 0; i < reference.size(); i++) {
+		for (int c = 0; c < 4; c++) {
+			glm::vec4 d = glm::abs(reference[i][c] - flat[i][c]);
+			maxError = std::max(maxError, std::max(std::max(d.x, d.y), std::max(d.z, d.w)));
+		}
+	}
+
+	std::cout << "Hierarchy compose, " << animation.getBonesSize() << " bones, " << iterations << " iterations\n"
+		<< "  recursive: " << recursiveMs << " ms\n"
+		<< "  flattened: " << flatMs << " ms (" << recursiveMs / flatMs << "x)\n"
+		<< "  max matrix element difference: " << maxError << "\n";
+}
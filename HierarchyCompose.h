@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <climits>
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include "SkeletalPose.h"
+
+class SkeletalAnimation;
+
+/**
+ * @brief One node of a skeleton hierarchy flattened so every parent comes before its children.
+ */
+struct HierarchyNode
+{
+	/*index of the parent node in the array, or -1 for the root*/
+	int parent;
+	/*bone id (palette index) of the node, or -1 if it is not a bone*/
+	int bone;
+	/*bone id of the nearest ancestor that is a bone, or -1*/
+	int parentBone;
+	/*the number of bones from the root down to and including this node*/
+	int boneDepth;
+	/*the node's own transform, used when the pose has no entry for it*/
+	glm::mat4 transformation;
+	/*the bone's mesh-to-bone offset matrix*/
+	glm::mat4 offset;
+	/*the constant transform of the nodes folded away between the parent and this bone (see Bake)*/
+	glm::mat4 prefix;
+	bool hasPrefix;
+};
+
+/**
+ * @brief Composes a pose into final bone matrices in one forward pass over a parent-ordered array,
+ * replacing the recursive name-lookup walk. The global inverse transform is folded into the root, so
+ * each bone costs two 4x4 multiplies (parent * local, global * offset), done with SSE or AVX, plus one
+ * for the folded prefix of a baked array.
+ */
+class HierarchyCompose
+{
+public:
+	/**
+	 * @brief out = a * b. out may alias a or b.
+	 */
+	static void Multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out);
+
+	/**
+	 * @brief T * R * S, built directly from the rotation matrix instead of two matrix products.
+	 */
+	static glm::mat4 LocalTransform(const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+	{
+		glm::mat3 r = glm::mat3_cast(rotation);
+		return glm::mat4(glm::vec4(r[0] * scale.x, 0.0f), glm::vec4(r[1] * scale.y, 0.0f),
+			glm::vec4(r[2] * scale.z, 0.0f), glm::vec4(translation, 1.0f));
+	}
+
+	/**
+	 * @brief Reduces a flattened hierarchy to its bones. Chains of nodes without a pose entry are constant,
+	 * so they are multiplied together once here and kept as the prefix of the bones below them, and
+	 * subtrees without a bone are dropped; composing then costs only per bone.
+	 * @param boneCount the pose size: nodes with a bone id at or above it count as unanimated nodes.
+	 */
+	static std::vector<HierarchyNode> Bake(const std::vector<HierarchyNode>& nodes, int boneCount);
+
+	/**
+	 * @param globals scratch space for the global transform of every node, resized as needed.
+	 * @param maxBoneDepth bones deeper than this are pruned: they are not composed, and take the matrix
+	 * of their nearest composed ancestor, as if held in their bind pose relative to it.
+	 */
+	static void Compose(const std::vector<HierarchyNode>& nodes, const glm::mat4& globalInverseTransform,
+		const SkeletalPose& pose, std::vector<glm::mat4>& globals, std::vector<glm::mat4>& finalBoneMatrices,
+		int maxBoneDepth = INT_MAX);
+
+	/**
+	 * @brief Times SkeletalAnimation::ComposePose against the recursive ComposePoseRecursive on the same pose,
+	 * and prints both together with the largest difference between their matrices.
+	 */
+	static void Benchmark(SkeletalAnimation& animation, const SkeletalPose& pose, int iterations = 1000);
+};
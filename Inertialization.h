@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include "SkeletalPose.h"
+
+/**
+ * @brief Inertialization (Bollo, "Inertialization: High-Performance Animation Transitions in Gears of War").
+ * Instead of crossfading, a transition cuts straight to the target animation, and the difference
+ * between the source pose and the target pose at the cut (and its velocity) is decayed to zero with
+ * a quintic curve. Only the target animation is sampled during the transition.
+ */
+class PoseInertializer
+{
+public:
+	/**
+	 * @brief Starts a transition.
+	 * @param source the last output pose before the cut.
+	 * @param previousSource the output pose the frame before that, for the velocity.
+	 * @param dt the time between previousSource and source.
+	 * @param target the first pose of the target animation.
+	 * @param blendTime the longest time the offset may take to decay.
+	 */
+	void start(const SkeletalPose& source, const SkeletalPose& previousSource, float dt,
+		const SkeletalPose& target, float blendTime)
+	{
+		size_t count = std::min(target.size(), std::min(source.size(), previousSource.size()));
+		m_Translations.resize(count);
+		m_Rotations.resize(count);
+		m_Scales.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			m_Translations[i] = VectorCurve(source.translations[i], previousSource.translations[i], target.translations[i], dt, blendTime);
+			m_Scales[i] = VectorCurve(source.scales[i], previousSource.scales[i], target.scales[i], dt, blendTime);
+			m_Rotations[i] = RotationCurve(source.rotations[i], previousSource.rotations[i], target.rotations[i], dt, blendTime);
+		}
+		m_Elapsed = 0.0f;
+		m_Duration = blendTime;
+	}
+
+	bool active() const
+	{
+		return m_Elapsed < m_Duration;
+	}
+
+	/**
+	 * @brief Advances the transition by dt and adds the remaining offset onto the target pose, in place.
+	 */
+	void apply(float dt, SkeletalPose& pose)
+	{
+		m_Elapsed += dt;
+		if (!active())
+			return;
+
+		size_t count = std::min(pose.size(), m_Translations.size());
+		for (size_t i = 0; i < count; i++)
+		{
+			pose.translations[i] += m_Translations[i].axis * m_Translations[i].evaluate(m_Elapsed);
+			pose.scales[i] += m_Scales[i].axis * m_Scales[i].evaluate(m_Elapsed);
+			float angle = m_Rotations[i].evaluate(m_Elapsed);
+			if (angle != 0.0f)
+				pose.rotations[i] = glm::normalize(glm::angleAxis(angle, m_Rotations[i].axis) * pose.rotations[i]);
+		}
+	}
+
+private:
+	/*the offset along one axis, x(t) = At^5 + Bt^4 + Ct^3 + Dt^2 + Et + F for t < t1, and zero after*/
+	struct Curve
+	{
+		glm::vec3 axis = glm::vec3(0.0f);
+		float A = 0.0f, B = 0.0f, C = 0.0f, D = 0.0f, E = 0.0f, F = 0.0f;
+		float t1 = 0.0f;
+
+		float evaluate(float t) const
+		{
+			if (t >= t1)
+				return 0.0f;
+			return (((((A * t + B) * t + C) * t + D) * t + E) * t) + F;
+		}
+	};
+
+	static Curve MakeCurve(const glm::vec3& axis, float x0, float v0, float blendTime)
+	{
+		Curve curve;
+		if (x0 <= 1e-6f || blendTime <= 0.0f)
+			return curve;
+
+		// Never let the offset overshoot: a velocity away from the target is dropped, and a fast one
+		// toward it shortens the transition.
+		v0 = std::min(v0, 0.0f);
+		float t1 = v0 < 0.0f ? std::min(blendTime, -5.0f * x0 / v0) : blendTime;
+		float a0 = std::max(0.0f, (-8.0f * v0 * t1 - 20.0f * x0) / (t1 * t1));
+
+		float t2 = t1 * t1, t3 = t2 * t1;
+		curve.axis = axis;
+		curve.t1 = t1;
+		curve.A = -(a0 * t2 + 6.0f * v0 * t1 + 12.0f * x0) / (2.0f * t3 * t2);
+		curve.B = (3.0f * a0 * t2 + 16.0f * v0 * t1 + 30.0f * x0) / (2.0f * t2 * t2);
+		curve.C = -(3.0f * a0 * t2 + 12.0f * v0 * t1 + 20.0f * x0) / (2.0f * t3);
+		curve.D = a0 / 2.0f;
+		curve.E = v0;
+		curve.F = x0;
+		return curve;
+	}
+
+	static Curve VectorCurve(const glm::vec3& source, const glm::vec3& previousSource, const glm::vec3& target,
+		float dt, float blendTime)
+	{
+		glm::vec3 offset = source - target;
+		float x0 = glm::length(offset);
+		if (x0 <= 1e-6f)
+			return Curve();
+		glm::vec3 axis = offset / x0;
+		float xPrevious = glm::dot(previousSource - target, axis);
+		float v0 = dt > 0.0f ? (x0 - xPrevious) / dt : 0.0f;
+		return MakeCurve(axis, x0, v0, blendTime);
+	}
+
+	static Curve RotationCurve(const glm::quat& source, const glm::quat& previousSource, const glm::quat& target,
+		float dt, float blendTime)
+	{
+		glm::quat offset = glm::normalize(source * glm::inverse(target));
+		if (offset.w < 0.0f)
+			offset = -offset;
+		glm::vec3 imaginary(offset.x, offset.y, offset.z);
+		float sinHalf = glm::length(imaginary);
+		if (sinHalf <= 1e-6f)
+			return Curve();
+		glm::vec3 axis = imaginary / sinHalf;
+		float x0 = 2.0f * std::atan2(sinHalf, offset.w);
+
+		glm::quat previous = glm::normalize(previousSource * glm::inverse(target));
+		if (previous.w < 0.0f)
+			previous = -previous;
+		float xPrevious = 2.0f * std::atan2(glm::dot(glm::vec3(previous.x, previous.y, previous.z), axis), previous.w);
+		float v0 = dt > 0.0f ? (x0 - xPrevious) / dt : 0.0f;
+		return MakeCurve(axis, x0, v0, blendTime);
+	}
+
+	std::vector<Curve> m_Translations;
+	std::vector<Curve> m_Rotations;
+	std::vector<Curve> m_Scales;
+	float m_Elapsed = 0.0f;
+	float m_Duration = 0.0f;
+};
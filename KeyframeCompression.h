@@ -0,0 +1,313 @@
+#pragma once
+
+/* Import-time compression of Bone channels */
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include "Bone.h"
+
+struct KeyframeCompressionSettings
+{
+	/*largest error allowed when dropping a position key, in model units*/
+	float positionTolerance = 0.001f;
+	/*largest error allowed when dropping a rotation key, in radians*/
+	float rotationTolerance = 0.0005f;
+	/*largest error allowed when dropping a scale key*/
+	float scaleTolerance = 0.0001f;
+};
+
+struct KeyframeCompressionReport
+{
+	size_t rawKeys = 0;
+	size_t compressedKeys = 0;
+	size_t rawBytes = 0;
+	size_t compressedBytes = 0;
+	/*largest distance between the translations of Bone::Update and of the compressed channels*/
+	float maxTranslationError = 0.0f;
+	/*largest difference between the rotation-scale columns of Bone::Update and of the compressed channels*/
+	float maxRotationScaleError = 0.0f;
+};
+
+/**
+ * @brief Finds the keys that cannot be rebuilt by interpolating their neighbours within tolerance.
+ * The first and last keys are always kept.
+ */
+template<class T, class Interpolate, class Distance>
+std::vector<size_t> ReduceKeys(const std::vector<float>& times, const std::vector<T>& values, float tolerance,
+	Interpolate interpolate, Distance distance)
+{
+	auto fits = [&](size_t from, size_t to) {
+		for (size_t k = from + 1; k < to; k++) {
+			float t = (times[k] - times[from]) / (times[to] - times[from]);
+			if (distance(interpolate(values[from], values[to], t), values[k]) > tolerance)
+				return false;
+		}
+		return true;
+	};
+
+	std::vector<size_t> kept = { 0 };
+	size_t i = 0;
+	while (i + 1 < values.size()) {
+		size_t j = i + 1;
+		while (j + 1 < values.size() && fits(i, j + 1))
+			j++;
+		kept.push_back(j);
+		i = j;
+	}
+	return kept;
+}
+
+/**
+ * @brief Key times of one channel, quantized to 16 bits over the channel's time range.
+ */
+class CompressedTimes
+{
+public:
+	CompressedTimes() = default;
+
+	CompressedTimes(const std::vector<float>& times, const std::vector<size_t>& kept)
+	{
+		m_Start = times[kept.front()];
+		m_Step = std::max(times[kept.back()] - m_Start, 1e-6f) / 65535.0f;
+		for (size_t index : kept)
+			m_Times.push_back((uint16_t)std::lround((times[index] - m_Start) / m_Step));
+	}
+
+	size_t size() const { return m_Times.size(); }
+	size_t bytes() const { return m_Times.size() * sizeof(uint16_t) + 2 * sizeof(float); }
+
+	/*finds the key before animationTime and the blend factor toward the key after it*/
+	void Locate(float animationTime, size_t& index, float& factor) const
+	{
+		float time = (animationTime - m_Start) / m_Step;
+		size_t upper = std::upper_bound(m_Times.begin(), m_Times.end(), time,
+			[](float t, uint16_t key) { return t < key; }) - m_Times.begin();
+		index = std::min(upper == 0 ? 0 : upper - 1, m_Times.size() - 2);
+		// Keys closer than a quantization step can round to the same tick.
+		float span = float(m_Times[index + 1] - m_Times[index]);
+		factor = span > 0.0f ? glm::clamp((time - m_Times[index]) / span, 0.0f, 1.0f) : 0.0f;
+	}
+
+private:
+	std::vector<uint16_t> m_Times;
+	float m_Start = 0.0f;
+	float m_Step = 1.0f;
+};
+
+/**
+ * @brief A position or scale channel: a single value if it never moves beyond tolerance, otherwise
+ * the keys that survive ReduceKeys, quantized to 16 bits per component over the channel's range.
+ */
+class CompressedVec3Track
+{
+public:
+	CompressedVec3Track() = default;
+
+	CompressedVec3Track(const std::vector<float>& times, const std::vector<glm::vec3>& values, float tolerance)
+	{
+		if (values.empty())
+			return;
+		m_Constant = values.front();
+		bool constant = std::all_of(values.begin(), values.end(),
+			[&](const glm::vec3& v) { return glm::length(v - m_Constant) <= tolerance; });
+		if (constant)
+			return;
+
+		auto kept = ReduceKeys(times, values, tolerance,
+			[](const glm::vec3& a, const glm::vec3& b, float t) { return glm::mix(a, b, t); },
+			[](const glm::vec3& a, const glm::vec3& b) { return glm::length(a - b); });
+
+		glm::vec3 max = values[kept.front()];
+		m_Min = max;
+		for (size_t index : kept) {
+			m_Min = glm::min(m_Min, values[index]);
+			max = glm::max(max, values[index]);
+		}
+		m_Extent = max - m_Min;
+
+		m_Times = CompressedTimes(times, kept);
+		for (size_t index : kept)
+			for (int c = 0; c < 3; c++) {
+				float normalized = m_Extent[c] > 0.0f ? (values[index][c] - m_Min[c]) / m_Extent[c] : 0.0f;
+				m_Values.push_back((uint16_t)std::lround(normalized * 65535.0f));
+			}
+	}
+
+	glm::vec3 Sample(float animationTime) const
+	{
+		if (m_Times.size() == 0)
+			return m_Constant;
+		size_t index;
+		float factor;
+		m_Times.Locate(animationTime, index, factor);
+		return glm::mix(Decode(index), Decode(index + 1), factor);
+	}
+
+	size_t keys() const { return std::max<size_t>(1, m_Times.size()); }
+	size_t bytes() const
+	{
+		return m_Times.size() == 0 ? sizeof(glm::vec3)
+			: m_Times.bytes() + m_Values.size() * sizeof(uint16_t) + 2 * sizeof(glm::vec3);
+	}
+
+private:
+	glm::vec3 Decode(size_t index) const
+	{
+		const uint16_t* q = &m_Values[index * 3];
+		return m_Min + m_Extent * glm::vec3(q[0], q[1], q[2]) / 65535.0f;
+	}
+
+	CompressedTimes m_Times;
+	std::vector<uint16_t> m_Values;
+	glm::vec3 m_Constant = glm::vec3(0.0f);
+	glm::vec3 m_Min = glm::vec3(0.0f);
+	glm::vec3 m_Extent = glm::vec3(0.0f);
+};
+
+/**
+ * @brief A rotation channel: a single value if it never turns beyond tolerance, otherwise the keys
+ * that survive ReduceKeys in the smallest-three encoding. The largest component of the unit quaternion
+ * is dropped and rebuilt from the other three, which are stored in 15 bits each, in [-1/sqrt(2), 1/sqrt(2)];
+ * the dropped component's index lives in the spare top bits.
+ */
+class CompressedQuatTrack
+{
+public:
+	CompressedQuatTrack() = default;
+
+	CompressedQuatTrack(const std::vector<float>& times, const std::vector<glm::quat>& values, float tolerance)
+	{
+		auto angle = [](const glm::quat& a, const glm::quat& b) {
+			return 2.0f * std::acos(std::min(1.0f, std::abs(glm::dot(glm::normalize(a), glm::normalize(b)))));
+		};
+
+		if (values.empty())
+			return;
+		m_Constant = glm::normalize(values.front());
+		bool constant = std::all_of(values.begin(), values.end(),
+			[&](const glm::quat& q) { return angle(q, m_Constant) <= tolerance; });
+		if (constant)
+			return;
+
+		auto kept = ReduceKeys(times, values, tolerance,
+			[](const glm::quat& a, const glm::quat& b, float t) { return glm::slerp(a, b, t); }, angle);
+
+		m_Times = CompressedTimes(times, kept);
+		m_Values.resize(kept.size() * 3);
+		for (size_t i = 0; i < kept.size(); i++)
+			Encode(values[kept[i]], &m_Values[i * 3]);
+	}
+
+	glm::quat Sample(float animationTime) const
+	{
+		if (m_Times.size() == 0)
+			return m_Constant;
+		size_t index;
+		float factor;
+		m_Times.Locate(animationTime, index, factor);
+		return glm::normalize(glm::slerp(Decode(index), Decode(index + 1), factor));
+	}
+
+	size_t keys() const { return std::max<size_t>(1, m_Times.size()); }
+	size_t bytes() const
+	{
+		return m_Times.size() == 0 ? sizeof(glm::quat) : m_Times.bytes() + m_Values.size() * sizeof(uint16_t);
+	}
+
+private:
+	static void Encode(const glm::quat& rotation, uint16_t* out)
+	{
+		glm::quat q = glm::normalize(rotation);
+		float c[4] = { q.x, q.y, q.z, q.w };
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+			if (std::abs(c[i]) > std::abs(c[largest]))
+				largest = i;
+		// q and -q are the same rotation, so make the dropped component positive.
+		float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+		for (int i = 0, o = 0; i < 4; i++) {
+			if (i == largest)
+				continue;
+			float normalized = glm::clamp(c[i] * sign * glm::root_two<float>() * 0.5f + 0.5f, 0.0f, 1.0f);
+			out[o++] = (uint16_t)std::lround(normalized * 32767.0f);
+		}
+		out[0] |= (largest & 1) << 15;
+		out[1] |= (largest >> 1) << 15;
+	}
+
+	glm::quat Decode(size_t index) const
+	{
+		const uint16_t* in = &m_Values[index * 3];
+		int largest = (in[0] >> 15) | ((in[1] >> 15) << 1);
+		float c[4];
+		float sum = 0.0f;
+		for (int i = 0, o = 0; i < 4; i++) {
+			if (i == largest)
+				continue;
+			c[i] = ((in[o++] & 0x7fff) / 32767.0f - 0.5f) * 2.0f / glm::root_two<float>();
+			sum += c[i] * c[i];
+		}
+		c[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+		return glm::quat(c[3], c[0], c[1], c[2]);
+	}
+
+	CompressedTimes m_Times;
+	std::vector<uint16_t> m_Values;
+	glm::quat m_Constant = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+};
+
+/**
+ * @brief The compressed channels of one Bone, sampled with the same interface.
+ */
+class CompressedBone
+{
+public:
+	CompressedBone(const Bone& bone, const KeyframeCompressionSettings& settings)
+		: m_ID(bone.GetBoneID())
+	{
+		std::vector<float> times;
+		std::vector<glm::vec3> vectors;
+		std::vector<glm::quat> rotations;
+
+		for (auto& key : bone.GetPositionKeys()) {
+			times.push_back(key.timeStamp);
+			vectors.push_back(key.position);
+		}
+		m_Positions = CompressedVec3Track(times, vectors, settings.positionTolerance);
+
+		times.clear();
+		for (auto& key : bone.GetRotationKeys()) {
+			times.push_back(key.timeStamp);
+			rotations.push_back(key.orientation);
+		}
+		m_Rotations = CompressedQuatTrack(times, rotations, settings.rotationTolerance);
+
+		times.clear();
+		vectors.clear();
+		for (auto& key : bone.GetScaleKeys()) {
+			times.push_back(key.timeStamp);
+			vectors.push_back(key.scale);
+		}
+		m_Scales = CompressedVec3Track(times, vectors, settings.scaleTolerance);
+	}
+
+	glm::vec3 SamplePosition(float animationTime) const { return m_Positions.Sample(animationTime); }
+	glm::quat SampleRotation(float animationTime) const { return m_Rotations.Sample(animationTime); }
+	glm::vec3 SampleScale(float animationTime) const { return m_Scales.Sample(animationTime); }
+	int GetBoneID() const { return m_ID; }
+	void SetBoneID(int id) { m_ID = id; }
+
+	size_t GetKeyCount() const { return m_Positions.keys() + m_Rotations.keys() + m_Scales.keys(); }
+	size_t GetByteSize() const { return sizeof(m_ID) + m_Positions.bytes() + m_Rotations.bytes() + m_Scales.bytes(); }
+
+private:
+	CompressedVec3Track m_Positions;
+	CompressedQuatTrack m_Rotations;
+	CompressedVec3Track m_Scales;
+	int m_ID;
+};
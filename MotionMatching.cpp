@@ -0,0 +1,320 @@
+#include "MotionMatching.h"
+#include <chrono>
+#include <climits>
+#include <iostream>
+
+#if defined(__AVX2__)
+#define MOTION_MATCHING_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MOTION_MATCHING_SSE
+#include <emmintrin.h>
+#endif
+
+// Feature groups, normalized together by the mean deviation of their features and then weighted.
+struct FeatureGroup {
+	int first;
+	int count;
+	float weight;
+};
+static const FeatureGroup FEATURE_GROUPS[] = {
+	{ 0, 2 * MotionDatabase::TRAJECTORY_POINTS, 1.0f },                                    // trajectory positions
+	{ 2 * MotionDatabase::TRAJECTORY_POINTS, 2 * MotionDatabase::TRAJECTORY_POINTS, 1.5f }, // trajectory facings
+	{ 4 * MotionDatabase::TRAJECTORY_POINTS, 6, 0.75f },                                   // foot positions
+	{ 4 * MotionDatabase::TRAJECTORY_POINTS + 6, 6, 1.0f },                                // foot velocities
+	{ 4 * MotionDatabase::TRAJECTORY_POINTS + 12, 3, 1.0f },                               // hips velocity
+};
+
+// Normalized features are quantized over [-QUANT_RANGE, QUANT_RANGE] to 12 bits, so the squared
+// differences of all FEATURE_STRIDE lanes add up within 32 bits.
+static const float QUANT_RANGE = 8.0f;
+static const int QUANT_MAX = 2047;
+static const float QUANT_SCALE = QUANT_MAX / QUANT_RANGE;
+
+static bool endsWith(const std::string& name, const std::string& ending) {
+	return name.size() >= ending.size() && name.compare(name.size() - ending.size(), ending.size(), ending) == 0;
+}
+
+static int32_t distanceScalar(const int16_t* a, const int16_t* b) {
+	int32_t sum = 0;
+	for (int i = 0; i < MotionDatabase::FEATURE_STRIDE; i++) {
+		int32_t d = int32_t(a[i]) - int32_t(b[i]);
+		sum += d * d;
+	}
+	return sum;
+}
+
+int MotionDatabase::addClip(SkeletalAnimation* clip, bool loop, const glm::vec3& inPlaceVelocity) {
+	m_Clips.push_back({ clip, loop, inPlaceVelocity, 0, 0 });
+	return (int)m_Clips.size() - 1;
+}
+
+void MotionDatabase::SampleBones(const Clip& clip, float time, glm::vec3 positions[3]) {
+	SkeletalAnimation& animation = *clip.clip;
+	time = std::min(time, std::nextafter(animation.GetDuration(), 0.0f));
+	m_Palette.resize(animation.getBonesSize());
+	animation.SamplePose(time, m_Pose, m_Workspace);
+	animation.ComposePose(m_Pose, m_Palette, m_Workspace);
+	for (int i = 0; i < 3; i++) {
+		// The palette holds global * offset; undoing the offset leaves the bone's model-space transform.
+		positions[i] = m_Bones[i] >= 0 ? glm::vec3((m_Palette[m_Bones[i]] * m_InverseOffsets[i])[3]) : glm::vec3(0.0f);
+	}
+}
+
+RootMotion MotionDatabase::Travel(const Clip& clip, float time, float seconds) {
+	SkeletalAnimation& animation = *clip.clip;
+	float duration = animation.GetDuration();
+	float remaining = seconds * animation.GetTicksPerSecond();
+	RootMotion travel;
+	glm::vec3 from[3], to[3];
+	while (remaining > 0.0f) {
+		float end = std::min(time + remaining, duration);
+		RootMotion step;
+		if (animation.HasRootMotion()) {
+			step = animation.GetRootMotion(time, end, false);
+		}
+		else {
+			SampleBones(clip, time, from);
+			SampleBones(clip, end, to);
+			step.translation = glm::vec3(to[2].x - from[2].x, 0.0f, to[2].z - from[2].z);
+		}
+		step.translation += clip.inPlaceVelocity * ((end - time) / animation.GetTicksPerSecond());
+		travel = travel.Then(step);
+		remaining -= end - time;
+		if (!clip.loop || end < duration) {
+			break;
+		}
+		time = 0.0f;
+	}
+	return travel;
+}
+
+void MotionDatabase::build(float samplesPerSecond, const std::string& leftFoot, const std::string& rightFoot, const std::string& hips) {
+	m_SamplesPerSecond = samplesPerSecond;
+	m_FrameClips.clear();
+	m_FrameTimes.clear();
+	m_Features.clear();
+	const float horizon = TRAJECTORY_TIMES[TRAJECTORY_POINTS - 1];
+	const float step = 1.0f / samplesPerSecond;
+
+	for (Clip& clip : m_Clips) {
+		SkeletalAnimation& animation = *clip.clip;
+		clip.firstFrame = (int)m_FrameClips.size();
+		clip.frameCount = 0;
+		if (animation.GetDuration() <= 0.0f || animation.GetTicksPerSecond() <= 0.0f) {
+			// Nothing to sample, and a looping trajectory over it would never advance.
+			std::cout << "ERROR::MOTION_MATCHING: " << animation.GetName() << " has no duration\n";
+			continue;
+		}
+		const std::string* names[3] = { &leftFoot, &rightFoot, &hips };
+		for (int i = 0; i < 3; i++) {
+			m_Bones[i] = -1;
+			for (auto& [name, info] : animation.GetBoneIDMap()) {
+				if (endsWith(name, *names[i]) && info.id < animation.getBonesSize()) {
+					m_Bones[i] = info.id;
+					m_InverseOffsets[i] = glm::inverse(info.offset);
+				}
+			}
+			if (m_Bones[i] < 0) {
+				std::cout << "ERROR::MOTION_MATCHING: no bone ending in " << *names[i] << " in " << animation.GetName() << "\n";
+			}
+		}
+
+		float seconds = animation.GetDuration() / animation.GetTicksPerSecond();
+		int frameCount = clip.loop ? std::max(1, (int)(seconds * samplesPerSecond))
+			: std::max(0, (int)((seconds - horizon) * samplesPerSecond) + 1);
+		clip.frameCount = frameCount;
+		for (int frame = 0; frame < frameCount; frame++) {
+			float time = frame * step * animation.GetTicksPerSecond();
+			float features[FEATURE_COUNT];
+			for (int p = 0; p < TRAJECTORY_POINTS; p++) {
+				RootMotion travel = Travel(clip, time, TRAJECTORY_TIMES[p]);
+				glm::vec3 facing = RootMotion::RotateYaw(glm::vec3(0.0f, 0.0f, 1.0f), travel.yaw);
+				features[2 * p] = travel.translation.x;
+				features[2 * p + 1] = travel.translation.z;
+				features[2 * TRAJECTORY_POINTS + 2 * p] = facing.x;
+				features[2 * TRAJECTORY_POINTS + 2 * p + 1] = facing.z;
+			}
+			glm::vec3 now[3], next[3];
+			SampleBones(clip, time, now);
+			float nextTime = time + step * animation.GetTicksPerSecond();
+			SampleBones(clip, clip.loop ? fmod(nextTime, animation.GetDuration()) : nextTime, next);
+			RootMotion moved = Travel(clip, time, step);
+			float* pose = features + 4 * TRAJECTORY_POINTS;
+			for (int c = 0; c < 3; c++) {
+				pose[c] = now[0][c];
+				pose[3 + c] = now[1][c];
+				// Across the loop the feet jump back with the root; their motion relative to it still holds.
+				pose[6 + c] = (next[0][c] - now[0][c] - (next[2][c] - now[2][c])) / step;
+				pose[9 + c] = (next[1][c] - now[1][c] - (next[2][c] - now[2][c])) / step;
+				pose[12 + c] = moved.translation[c] / step;
+			}
+			m_Features.insert(m_Features.end(), features, features + FEATURE_COUNT);
+			m_FrameClips.push_back((int)(&clip - m_Clips.data()));
+			m_FrameTimes.push_back(time);
+		}
+	}
+
+	size_t count = m_FrameClips.size();
+	for (const FeatureGroup& group : FEATURE_GROUPS) {
+		float variance = 0.0f;
+		for (int f = group.first; f < group.first + group.count; f++) {
+			double sum = 0.0, squares = 0.0;
+			for (size_t i = 0; i < count; i++) {
+				sum += m_Features[i * FEATURE_COUNT + f];
+			}
+			m_Mean[f] = count ? float(sum / count) : 0.0f;
+			for (size_t i = 0; i < count; i++) {
+				double d = m_Features[i * FEATURE_COUNT + f] - m_Mean[f];
+				squares += d * d;
+			}
+			variance += count ? float(squares / count) : 0.0f;
+		}
+		float deviation = std::sqrt(variance / group.count);
+		for (int f = group.first; f < group.first + group.count; f++) {
+			m_Scale[f] = group.weight / std::max(deviation, 1e-4f);
+		}
+	}
+
+	m_Quantized.assign(count * FEATURE_STRIDE, 0);
+	for (size_t i = 0; i < count; i++) {
+		Quantize(&m_Features[i * FEATURE_COUNT], &m_Quantized[i * FEATURE_STRIDE]);
+	}
+	std::cout << "Motion database: " << m_Clips.size() << " clips, " << count << " frames, "
+		<< m_Quantized.size() * sizeof(int16_t) / 1024.0f << " KB\n";
+}
+
+void MotionDatabase::Quantize(const float* features, int16_t* quantized) const {
+	for (int f = 0; f < FEATURE_COUNT; f++) {
+		float q = std::round((features[f] - m_Mean[f]) * m_Scale[f] * QUANT_SCALE);
+		quantized[f] = (int16_t)std::clamp(q, -float(QUANT_MAX), float(QUANT_MAX));
+	}
+	std::fill(quantized + FEATURE_COUNT, quantized + FEATURE_STRIDE, int16_t(0));
+}
+
+MotionDatabase::Match MotionDatabase::search(const float* query, bool simd) const {
+	Match match;
+	size_t count = m_FrameClips.size();
+	if (count == 0) {
+		return match;
+	}
+	alignas(32) int16_t q[FEATURE_STRIDE];
+	Quantize(query, q);
+
+	size_t best = 0;
+	int32_t bestDistance = INT32_MAX;
+	const int16_t* rows = m_Quantized.data();
+	if (!simd) {
+		for (size_t i = 0; i < count; i++) {
+			int32_t distance = distanceScalar(rows + i * FEATURE_STRIDE, q);
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				best = i;
+			}
+		}
+	}
+	else {
+#if defined(MOTION_MATCHING_AVX2)
+		__m256i q0 = _mm256_load_si256((const __m256i*)q);
+		__m256i q1 = _mm256_load_si256((const __m256i*)(q + 16));
+		for (size_t i = 0; i < count; i++) {
+			const int16_t* row = rows + i * FEATURE_STRIDE;
+			__m256i d0 = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)row), q0);
+			__m256i d1 = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i*)(row + 16)), q1);
+			__m256i sum = _mm256_add_epi32(_mm256_madd_epi16(d0, d0), _mm256_madd_epi16(d1, d1));
+			__m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+			half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+			half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+			int32_t distance = _mm_cvtsi128_si32(half);
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				best = i;
+			}
+		}
+#elif defined(MOTION_MATCHING_SSE)
+		__m128i qs[4];
+		for (int j = 0; j < 4; j++) {
+			qs[j] = _mm_load_si128((const __m128i*)(q + 8 * j));
+		}
+		for (size_t i = 0; i < count; i++) {
+			const int16_t* row = rows + i * FEATURE_STRIDE;
+			__m128i sum = _mm_setzero_si128();
+			for (int j = 0; j < 4; j++) {
+				__m128i d = _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(row + 8 * j)), qs[j]);
+				sum = _mm_add_epi32(sum, _mm_madd_epi16(d, d));
+			}
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+			sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+			int32_t distance = _mm_cvtsi128_si32(sum);
+			if (distance < bestDistance) {
+				bestDistance = distance;
+				best = i;
+			}
+		}
+#else
+		return search(query, false);
+#endif
+	}
+
+	match.clip = m_FrameClips[best];
+	match.time = m_FrameTimes[best];
+	match.cost = bestDistance / (QUANT_SCALE * QUANT_SCALE);
+	return match;
+}
+
+const float* MotionDatabase::getFeatures(int clip, float time) const {
+	const Clip& c = m_Clips[clip];
+	int frame = (int)std::round(time / c.clip->GetTicksPerSecond() * m_SamplesPerSecond);
+	if (c.loop && frame >= c.frameCount) {
+		frame = 0;
+	}
+	frame = std::clamp(frame, 0, std::max(c.frameCount - 1, 0));
+	return &m_Features[(c.firstFrame + frame) * FEATURE_COUNT];
+}
+
+void MotionDatabase::FillTrajectory(const glm::vec3& velocity, float* features) {
+	glm::vec2 direction(velocity.x, velocity.z);
+	float speed = glm::length(direction);
+	glm::vec2 facing = speed > 1e-4f ? direction / speed : glm::vec2(0.0f, 1.0f);
+	for (int p = 0; p < TRAJECTORY_POINTS; p++) {
+		features[2 * p] = direction.x * TRAJECTORY_TIMES[p];
+		features[2 * p + 1] = direction.y * TRAJECTORY_TIMES[p];
+		features[2 * TRAJECTORY_POINTS + 2 * p] = facing.x;
+		features[2 * TRAJECTORY_POINTS + 2 * p + 1] = facing.y;
+	}
+}
+
+void MotionDatabase::Benchmark(int iterations) const {
+	using clock = std::chrono::high_resolution_clock;
+	size_t count = m_FrameClips.size();
+	if (count == 0) {
+		return;
+	}
+	std::vector<float> queries(iterations * FEATURE_COUNT);
+	for (int i = 0; i < iterations; i++) {
+		float* query = &queries[i * FEATURE_COUNT];
+		std::copy_n(&m_Features[(i * 7919 % count) * FEATURE_COUNT], FEATURE_COUNT, query);
+		float angle = i * 0.37f;
+		FillTrajectory(glm::vec3(std::sin(angle), 0.0f, std::cos(angle)) * float(i % 5), query);
+	}
+
+	std::vector<Match> scalar(iterations), simd(iterations);
+	auto time = [&](bool useSimd, std::vector<Match>& matches) {
+		auto start = clock::now();
+		for (int i = 0; i < iterations; i++) {
+			matches[i] = search(&queries[i * FEATURE_COUNT], useSimd);
+		}
+		return std::chrono::duration<double, std::micro>(clock::now() - start).count() / iterations;
+	};
+	double scalarUs = time(false, scalar);
+	double simdUs = time(true, simd);
+	int agree = 0;
+	for (int i = 0; i < iterations; i++) {
+		agree += scalar[i].cost == simd[i].cost;
+	}
+
+	std::cout << "Motion matching search, " << count << " frames, " << iterations << " queries\n"
+		<< "  scalar: " << scalarUs << " us per query\n"
+		<< "  simd:   " << simdUs << " us per query (" << scalarUs / simdUs << "x)\n"
+		<< "  same cost: " << agree << " of " << iterations << "\n";
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "SkeletalAnimation.h"
+#include "AnimationGraph.h"
+#include "RootMotion.h"
+
+/**
+ * @brief Every frame of a set of clips, described by features in the character's model space at that
+ * frame: where the character will be and which way it will face at TRAJECTORY_TIMES, where its feet are
+ * and how fast they and the hips move. Searching it for the frame nearest to a query is motion matching.
+ * Features are normalized per group, weighted and quantized to 12 bits, held in 16-bit lanes so the
+ * 32-bit sums of squared differences cannot overflow; the search is a brute-force SIMD sweep (SSE2 or
+ * AVX2) over the whole database, a few microseconds per thousand frames.
+ */
+class MotionDatabase
+{
+public:
+	static constexpr int TRAJECTORY_POINTS = 3;
+	/*seconds ahead of each trajectory point*/
+	static constexpr float TRAJECTORY_TIMES[TRAJECTORY_POINTS] = { 1.0f / 3.0f, 2.0f / 3.0f, 1.0f };
+	/*xz positions and xz facings of the trajectory, then left and right foot positions, their velocities and the hips velocity*/
+	static constexpr int FEATURE_COUNT = 4 * TRAJECTORY_POINTS + 5 * 3;
+	/*features padded to whole SIMD registers of 16-bit lanes*/
+	static constexpr int FEATURE_STRIDE = 32;
+
+	/*a frame of the database: a clip index and a time in its ticks*/
+	struct Match
+	{
+		int clip = -1;
+		float time = 0.0f;
+		/*the weighted, normalized squared distance to the query*/
+		float cost = 0.0f;
+	};
+
+	/**
+	 * @brief Adds a clip to the database; call build() after the last one.
+	 * @param inPlaceVelocity for clips authored in place, the velocity (model space, units per second) the
+	 * character moves at while the clip plays. Zero for clips whose root travels or that extract root motion.
+	 * @return the clip's index.
+	 */
+	int addClip(SkeletalAnimation* clip, bool loop, const glm::vec3& inPlaceVelocity = glm::vec3(0.0f));
+
+	/**
+	 * @brief Samples every clip at samplesPerSecond and extracts, normalizes and quantizes the features of
+	 * each frame. Frames of non-looping clips less than a trajectory from their end are left out, so a match
+	 * can always play on. The feet and hips are found by the endings of the bone names.
+	 */
+	void build(float samplesPerSecond = 30.0f, const std::string& leftFoot = "LeftFoot",
+		const std::string& rightFoot = "RightFoot", const std::string& hips = "Hips");
+
+	/**
+	 * @brief The frame nearest to query, FEATURE_COUNT raw features, with the SIMD kernel or the scalar reference.
+	 */
+	Match search(const float* query, bool simd = true) const;
+
+	/*the raw features of the frame nearest to time (ticks) in clip, as the pose half of a query*/
+	const float* getFeatures(int clip, float time) const;
+
+	/**
+	 * @brief Writes the trajectory half of a query for a character that wants to move at velocity (model space):
+	 * straight along it, facing it, or standing and facing ahead when it is zero.
+	 */
+	static void FillTrajectory(const glm::vec3& velocity, float* features);
+
+	SkeletalAnimation* getClip(int clip) const { return m_Clips[clip].clip; }
+	bool isLooping(int clip) const { return m_Clips[clip].loop; }
+	size_t getFrameCount() const { return m_FrameClips.size(); }
+
+	/**
+	 * @brief Times search() with the scalar and the SIMD kernel on queries made from the database's own
+	 * frames with their trajectories replaced, and prints both with how often the two agree.
+	 */
+	void Benchmark(int iterations = 1000) const;
+
+private:
+	struct Clip
+	{
+		SkeletalAnimation* clip;
+		bool loop;
+		glm::vec3 inPlaceVelocity;
+		int firstFrame;
+		int frameCount;
+	};
+
+	/*the model-space positions of the feet and hips at time*/
+	void SampleBones(const Clip& clip, float time, glm::vec3 positions[3]);
+	/*how far the character travels and turns from time over the next seconds, wrapping looping clips*/
+	RootMotion Travel(const Clip& clip, float time, float seconds);
+	void Quantize(const float* features, int16_t* quantized) const;
+
+	std::vector<Clip> m_Clips;
+	float m_SamplesPerSecond = 30.0f;
+	/*per frame: its clip, its time in ticks, its raw features and its quantized features*/
+	std::vector<int> m_FrameClips;
+	std::vector<float> m_FrameTimes;
+	std::vector<float> m_Features;
+	std::vector<int16_t> m_Quantized;
+	/*per feature: the mean, and the weight over the standard deviation of its group*/
+	float m_Mean[FEATURE_COUNT] = {};
+	float m_Scale[FEATURE_COUNT] = {};
+	/*build scratch*/
+	int m_Bones[3] = { -1, -1, -1 };
+	glm::mat4 m_InverseOffsets[3];
+	SkeletalPose m_Pose;
+	PoseWorkspace m_Workspace;
+	std::vector<glm::mat4> m_Palette;
+};
+
+/**
+ * @brief Plays whatever frame of a MotionDatabase best continues the current pose toward a goal velocity.
+ * Call setGoal() and Search() before each update of the graph, and inertialize the graph when Search()
+ * reports a jump, so the cut to the new frame blends without sampling the old one.
+ */
+class MotionMatchingNode : public AnimationNode
+{
+public:
+	/**
+	 * @param searchInterval seconds between searches.
+	 * @param minJump matches closer than this (seconds) to the playing frame of the same clip are not jumped to.
+	 */
+	MotionMatchingNode(MotionDatabase* database, float searchInterval = 0.1f, float minJump = 0.2f)
+		: m_Database(database), m_SearchInterval(searchInterval), m_MinJump(minJump), m_SinceSearch(searchInterval)
+	{
+	}
+
+	/*the velocity the character should move at, in its model space*/
+	void setGoal(const glm::vec3& velocity)
+	{
+		m_Goal = velocity;
+	}
+
+	/**
+	 * @brief Searches the database once the search interval has passed.
+	 * @return whether the next Update jumps to another frame.
+	 */
+	bool Search()
+	{
+		if (m_SinceSearch < m_SearchInterval || m_Database->getFrameCount() == 0)
+			return false;
+		m_SinceSearch = 0.0f;
+
+		float query[MotionDatabase::FEATURE_COUNT] = {};
+		if (m_Clip >= 0)
+			std::copy_n(m_Database->getFeatures(m_Clip, m_Time), MotionDatabase::FEATURE_COUNT, query);
+		MotionDatabase::FillTrajectory(m_Goal, query);
+		MotionDatabase::Match match = m_Database->search(query);
+		if (match.clip < 0)
+			return false;
+		float ticksPerSecond = m_Database->getClip(match.clip)->GetTicksPerSecond();
+		if (match.clip == m_Clip && std::abs(match.time - m_Time) < m_MinJump * ticksPerSecond)
+			return false;
+		m_Pending = match;
+		// The very first frame has nothing to blend from.
+		return m_Clip >= 0;
+	}
+
+	void Update(float dt) override
+	{
+		if (m_Pending.clip >= 0)
+		{
+			m_Clip = m_Pending.clip;
+			m_Time = m_Pending.time;
+			m_Pending = MotionDatabase::Match();
+		}
+		m_SinceSearch += dt;
+		if (m_Clip < 0)
+		{
+			if (m_Database->getFrameCount() == 0)
+				return;
+			m_Clip = 0;
+		}
+
+		SkeletalAnimation* clip = m_Database->getClip(m_Clip);
+		bool loop = m_Database->isLooping(m_Clip);
+		float previous = m_Time;
+		m_Time += clip->GetTicksPerSecond() * dt;
+		bool wrapped = loop && m_Time >= clip->GetDuration();
+		if (loop)
+			m_Time = fmod(m_Time, clip->GetDuration());
+		else if (m_Time >= clip->GetDuration())
+		{
+			m_Time = clip->GetDuration();
+			// Out of frames: search again next time, whatever the interval.
+			m_SinceSearch = m_SearchInterval;
+		}
+		m_RootMotion = clip->GetRootMotion(previous, m_Time, wrapped);
+	}
+
+	void Evaluate(float weight, SkeletalPose& accumulator) override
+	{
+		if (m_Clip < 0)
+			return;
+		SkeletalAnimation* clip = m_Database->getClip(m_Clip);
+		clip->AccumulatePose(std::min(m_Time, std::nextafter(clip->GetDuration(), 0.0f)), weight, accumulator);
+		accumulator.rootMotion.Accumulate(m_RootMotion, weight);
+	}
+
+	void Reset() override
+	{
+		m_SinceSearch = m_SearchInterval;
+		m_RootMotion = RootMotion();
+	}
+
+	/*the frame being played*/
+	int getCurrentClip() const { return m_Clip; }
+	float getCurrentTime() const { return m_Time; }
+
+private:
+	MotionDatabase* m_Database;
+	float m_SearchInterval;
+	float m_MinJump;
+	float m_SinceSearch;
+	glm::vec3 m_Goal = glm::vec3(0.0f);
+	int m_Clip = -1;
+	float m_Time = 0.0f;
+	MotionDatabase::Match m_Pending;
+	RootMotion m_RootMotion;
+};
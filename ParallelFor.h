@@ -0,0 +1,176 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Worker threads started once and shared by every parallelFor, so per-frame work does not pay
+ * for creating and joining threads on each call. A thread waiting for its ranges runs queued ranges
+ * itself, so nested and concurrent calls cannot deadlock.
+ */
+class WorkerPool {
+public:
+	/*the process-wide pool, one worker per hardware thread besides the caller's*/
+	static WorkerPool& instance() {
+		static WorkerPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+		return pool;
+	}
+
+	explicit WorkerPool(unsigned workers) {
+		m_Workers.reserve(workers);
+		for (unsigned i = 0; i < workers; i++) {
+			m_Workers.emplace_back([this]() { work(); });
+		}
+	}
+
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stopping = true;
+		}
+		m_WorkReady.notify_all();
+		for (auto& worker : m_Workers) {
+			worker.join();
+		}
+	}
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	size_t getWorkerCount() const { return m_Workers.size(); }
+
+	/**
+	 * @brief Calls fn(begin, end) for consecutive ranges of batch items covering [0, count): the first
+	 * on the calling thread, the rest on the workers. Returns once every range is done, even if one
+	 * throws; the first exception thrown is then rethrown on the calling thread.
+	 */
+	template<class F>
+	void run(size_t count, size_t batch, F& fn) {
+		// Jobs point into this frame, so it must outlive every one of them.
+		Call call;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			for (size_t begin = batch; begin < count; begin += batch) {
+				m_Jobs.push_back({ &invoke<F>, &fn, begin, std::min(count, begin + batch), &call });
+				call.pending++;
+			}
+		}
+		m_WorkReady.notify_all();
+		try {
+			fn(size_t(0), std::min(count, batch));
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (!call.error) {
+				call.error = std::current_exception();
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		while (call.pending > 0) {
+			if (!m_Jobs.empty()) {
+				runJob(lock);
+			}
+			else {
+				m_JobDone.wait(lock);
+			}
+		}
+		if (call.error) {
+			std::rethrow_exception(call.error);
+		}
+	}
+
+private:
+	/*one call of run(); guarded by m_Mutex*/
+	struct Call {
+		/*its ranges still to finish*/
+		size_t pending = 0;
+		std::exception_ptr error;
+	};
+
+	struct Job {
+		void (*invoke)(void* fn, size_t begin, size_t end);
+		void* fn;
+		size_t begin;
+		size_t end;
+		Call* call;
+	};
+
+	template<class F>
+	static void invoke(void* fn, size_t begin, size_t end) {
+		(*static_cast<F*>(fn))(begin, end);
+	}
+
+	/*takes the oldest job and runs it unlocked; lock is held on entry and on return*/
+	void runJob(std::unique_lock<std::mutex>& lock) {
+		Job job = m_Jobs.front();
+		m_Jobs.pop_front();
+		lock.unlock();
+		std::exception_ptr error;
+		try {
+			job.invoke(job.fn, job.begin, job.end);
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+		lock.lock();
+		if (error && !job.call->error) {
+			job.call->error = error;
+		}
+		job.call->pending--;
+		m_JobDone.notify_all();
+	}
+
+	void work() {
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		while (true) {
+			m_WorkReady.wait(lock, [this]() { return m_Stopping || !m_Jobs.empty(); });
+			if (m_Jobs.empty()) {
+				return;
+			}
+			runJob(lock);
+		}
+	}
+
+	std::vector<std::thread> m_Workers;
+	std::deque<Job> m_Jobs;
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkReady;
+	std::condition_variable m_JobDone;
+	bool m_Stopping = false;
+};
+
+/**
+ * @brief The number of threads, the caller's included, that parallelFor uses for the same arguments.
+ */
+inline size_t parallelForThreads(size_t count, size_t minBatch, unsigned maxThreads = 0) {
+	size_t available = WorkerPool::instance().getWorkerCount() + 1;
+	size_t threads = maxThreads == 0 ? available : std::min<size_t>(maxThreads, available);
+	return std::min(threads, std::max<size_t>(1, count / std::max<size_t>(1, minBatch)));
+}
+
+/**
+ * @brief Splits [0, count) into contiguous ranges and calls fn(begin, end) for each range on the shared
+ * WorkerPool. The calling thread processes the first range. Ranges are never smaller than minBatch, so
+ * small workloads stay on the calling thread.
+ * @param maxThreads the upper bound on threads to use, the caller's included; 0 means one per pool
+ * worker plus the caller.
+ */
+template<class F>
+void parallelFor(size_t count, size_t minBatch, F&& fn, unsigned maxThreads = 0) {
+	if (count == 0) {
+		return;
+	}
+	size_t threads = parallelForThreads(count, minBatch, maxThreads);
+	if (threads <= 1) {
+		fn(size_t(0), count);
+		return;
+	}
+
+	size_t batch = (count + threads - 1) / threads;
+	WorkerPool::instance().run(count, batch, fn);
+}
@@ -0,0 +1,218 @@
+#include "PoseSampling.h"
+#include "SkeletalAnimation.h"
+#include "ResampledAnimation.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#if defined(__AVX__)
+#define POSE_SAMPLING_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define POSE_SAMPLING_SSE
+#include <emmintrin.h>
+#endif
+
+typedef ResampledAnimation Frame;
+
+// Streams blended with a plain lerp.
+static const int LINEAR_COMPONENTS[] = { Frame::TX, Frame::TY, Frame::TZ, Frame::SX, Frame::SY, Frame::SZ };
+
+/**
+ * @brief Adjusts the nlerp blend factor so the result follows slerp closely (Kapoulkine, "Approximating slerp").
+ * @param d the cosine of the angle between the two quaternions, in [0, 1].
+ */
+static inline float correctFactor(float t, float d) {
+	float A = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+	float B = 0.848013f + d * (-1.06021f + d * 0.215638f);
+	float k = A * (t - 0.5f) * (t - 0.5f) + B;
+	return t + t * (t - 0.5f) * (t - 1.0f) * k;
+}
+
+PoseSampling::Kernel PoseSampling::BestKernel() {
+#if defined(POSE_SAMPLING_AVX)
+	return Kernel::AVX;
+#elif defined(POSE_SAMPLING_SSE)
+	return Kernel::SSE;
+#else
+	return Kernel::Scalar;
+#endif
+}
+
+const char* PoseSampling::KernelName(Kernel kernel) {
+	switch (kernel) {
+	case Kernel::AVX: return "AVX";
+	case Kernel::SSE: return "SSE";
+	default: return "scalar";
+	}
+}
+
+void PoseSampling::BlendScalar(const float* a, const float* b, float alpha, size_t stride, bool slerpCorrection, float* out) {
+	for (int k : LINEAR_COMPONENTS) {
+		for (size_t c = 0; c < stride; c++) {
+			size_t i = k * stride + c;
+			out[i] = a[i] + (b[i] - a[i]) * alpha;
+		}
+	}
+
+	const float* ar[4] = { a + Frame::RX * stride, a + Frame::RY * stride, a + Frame::RZ * stride, a + Frame::RW * stride };
+	const float* br[4] = { b + Frame::RX * stride, b + Frame::RY * stride, b + Frame::RZ * stride, b + Frame::RW * stride };
+	float* outr[4] = { out + Frame::RX * stride, out + Frame::RY * stride, out + Frame::RZ * stride, out + Frame::RW * stride };
+	for (size_t c = 0; c < stride; c++) {
+		float d = ar[0][c] * br[0][c] + ar[1][c] * br[1][c] + ar[2][c] * br[2][c] + ar[3][c] * br[3][c];
+		float sign = d < 0.0f ? -1.0f : 1.0f;
+		float t = slerpCorrection ? correctFactor(alpha, std::abs(d)) : alpha;
+		float r[4];
+		float lengthSquared = 0.0f;
+		for (int j = 0; j < 4; j++) {
+			r[j] = ar[j][c] + (sign * br[j][c] - ar[j][c]) * t;
+			lengthSquared += r[j] * r[j];
+		}
+		float inverse = 1.0f / std::sqrt(std::max(lengthSquared, 1e-30f));
+		for (int j = 0; j < 4; j++)
+			outr[j][c] = r[j] * inverse;
+	}
+}
+
+#if defined(POSE_SAMPLING_AVX) || defined(POSE_SAMPLING_SSE)
+
+// The same kernel is written once over these wrappers, for 8 AVX lanes or 4 SSE lanes.
+#if defined(POSE_SAMPLING_AVX)
+typedef __m256 vfloat;
+static const size_t LANES = 8;
+static inline vfloat vload(const float* p) { return _mm256_loadu_ps(p); }
+static inline void vstore(float* p, vfloat v) { _mm256_storeu_ps(p, v); }
+static inline vfloat vset(float f) { return _mm256_set1_ps(f); }
+static inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+static inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+static inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+static inline vfloat vand(vfloat a, vfloat b) { return _mm256_and_ps(a, b); }
+static inline vfloat vandnot(vfloat a, vfloat b) { return _mm256_andnot_ps(a, b); }
+static inline vfloat vxor(vfloat a, vfloat b) { return _mm256_xor_ps(a, b); }
+static inline vfloat vsqrt(vfloat a) { return _mm256_sqrt_ps(a); }
+static inline vfloat vdiv(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+#else
+typedef __m128 vfloat;
+static const size_t LANES = 4;
+static inline vfloat vload(const float* p) { return _mm_loadu_ps(p); }
+static inline void vstore(float* p, vfloat v) { _mm_storeu_ps(p, v); }
+static inline vfloat vset(float f) { return _mm_set1_ps(f); }
+static inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+static inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+static inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+static inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+static inline vfloat vand(vfloat a, vfloat b) { return _mm_and_ps(a, b); }
+static inline vfloat vandnot(vfloat a, vfloat b) { return _mm_andnot_ps(a, b); }
+static inline vfloat vxor(vfloat a, vfloat b) { return _mm_xor_ps(a, b); }
+static inline vfloat vsqrt(vfloat a) { return _mm_sqrt_ps(a); }
+static inline vfloat vdiv(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+#endif
+
+/**
+ * @brief correctFactor() for a lane of cosines at once.
+ */
+static inline vfloat correctFactor(vfloat t, vfloat d) {
+	vfloat A = vadd(vset(1.0904f), vmul(d, vadd(vset(-3.2452f), vmul(d, vsub(vset(3.55645f), vmul(d, vset(1.43519f)))))));
+	vfloat B = vadd(vset(0.848013f), vmul(d, vadd(vset(-1.06021f), vmul(d, vset(0.215638f)))));
+	vfloat centered = vsub(t, vset(0.5f));
+	vfloat k = vadd(vmul(vmul(A, centered), centered), B);
+	return vadd(t, vmul(vmul(vmul(t, centered), vsub(t, vset(1.0f))), k));
+}
+
+#endif
+
+void PoseSampling::BlendSimd(const float* a, const float* b, float alpha, size_t stride, bool slerpCorrection, float* out) {
+#if defined(POSE_SAMPLING_AVX) || defined(POSE_SAMPLING_SSE)
+	const vfloat t = vset(alpha);
+	for (int k : LINEAR_COMPONENTS) {
+		for (size_t c = 0; c < stride; c += LANES) {
+			size_t i = k * stride + c;
+			vfloat va = vload(a + i);
+			vstore(out + i, vadd(va, vmul(vsub(vload(b + i), va), t)));
+		}
+	}
+
+	const vfloat signBit = vset(-0.0f);
+	for (size_t c = 0; c < stride; c += LANES) {
+		vfloat ar[4], br[4];
+		for (int j = 0; j < 4; j++) {
+			ar[j] = vload(a + (Frame::RX + j) * stride + c);
+			br[j] = vload(b + (Frame::RX + j) * stride + c);
+		}
+		vfloat d = vadd(vadd(vmul(ar[0], br[0]), vmul(ar[1], br[1])), vadd(vmul(ar[2], br[2]), vmul(ar[3], br[3])));
+		// Flip b into a's hemisphere by moving the sign of d onto it.
+		vfloat sign = vand(d, signBit);
+		vfloat factor = slerpCorrection ? correctFactor(t, vandnot(signBit, d)) : t;
+
+		vfloat r[4];
+		vfloat lengthSquared = vset(0.0f);
+		for (int j = 0; j < 4; j++) {
+			r[j] = vadd(ar[j], vmul(vsub(vxor(br[j], sign), ar[j]), factor));
+			lengthSquared = vadd(lengthSquared, vmul(r[j], r[j]));
+		}
+		vfloat length = vsqrt(vmax(lengthSquared, vset(1e-30f)));
+		for (int j = 0; j < 4; j++)
+			vstore(out + (Frame::RX + j) * stride + c, vdiv(r[j], length));
+	}
+#else
+	BlendScalar(a, b, alpha, stride, slerpCorrection, out);
+#endif
+}
+
+void PoseSampling::Benchmark(const SkeletalAnimation& clip, float framesPerSecond, int iterations) {
+	using clock = std::chrono::high_resolution_clock;
+	SkeletalAnimation raw = clip;
+	SkeletalAnimation resampled = clip;
+	resampled.Resample(framesPerSecond);
+	ResampledAnimation& frames = resampled.GetResampled();
+
+	// Sweep the clip, staying below its end where Bone has no key to the right.
+	auto timeAt = [&](int i) { return raw.GetDuration() * i / iterations; };
+	auto time = [iterations](auto&& run) {
+		auto start = clock::now();
+		for (int i = 0; i < iterations; i++) {
+			run(i);
+		}
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count() / iterations;
+	};
+
+	SkeletalPose rawPose, resampledPose;
+	std::vector<float> blended(frames.GetStride() * ResampledAnimation::COMPONENT_COUNT);
+	auto blend = [&](int i, bool simd) {
+		int frame, next;
+		float alpha;
+		frames.Locate(timeAt(i), frame, next, alpha);
+		if (simd)
+			BlendSimd(frames.GetFrame(frame), frames.GetFrame(next), alpha, frames.GetStride(), true, blended.data());
+		else
+			BlendScalar(frames.GetFrame(frame), frames.GetFrame(next), alpha, frames.GetStride(), true, blended.data());
+	};
+
+	double boneMs = time([&](int i) { raw.SamplePose(timeAt(i), rawPose); });
+	double resampledMs = time([&](int i) { resampled.SamplePose(timeAt(i), resampledPose); });
+	double scalarMs = time([&](int i) { blend(i, false); });
+	double simdMs = time([&](int i) { blend(i, true); });
+
+	float maxTranslationError = 0.0f;
+	float maxRotationError = 0.0f;
+	for (int i = 0; i < iterations; i++) {
+		raw.SamplePose(timeAt(i), rawPose);
+		resampled.SamplePose(timeAt(i), resampledPose);
+		for (size_t bone = 0; bone < rawPose.size(); bone++) {
+			maxTranslationError = std::max(maxTranslationError,
+				glm::length(rawPose.translations[bone] - resampledPose.translations[bone]));
+			float d = std::min(1.0f, std::abs(glm::dot(rawPose.rotations[bone], resampledPose.rotations[bone])));
+			maxRotationError = std::max(maxRotationError, 2.0f * std::acos(d));
+		}
+	}
+
+	const char* kernel = KernelName(BestKernel());
+	std::cout << "Pose sampling, " << frames.GetChannelCount() << " channels, " << iterations << " iterations\n"
+		<< "  per-Bone SamplePose: " << boneMs << " ms\n"
+		<< "  resampled SamplePose (" << kernel << "): " << resampledMs << " ms (" << boneMs / resampledMs << "x)\n"
+		<< "  blend kernel, scalar: " << scalarMs << " ms, " << kernel << ": " << simdMs << " ms (" << scalarMs / simdMs << "x)\n"
+		<< "  max error vs per-Bone at " << framesPerSecond << " fps: translation " << maxTranslationError
+		<< ", rotation " << maxRotationError << " rad\n";
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+
+class SkeletalAnimation;
+
+/**
+ * @brief Blends two frames of a ResampledAnimation for all channels at once. Frames are stored as
+ * component streams (see ResampledAnimation), so the SSE and AVX kernels process 4 or 8 channels per
+ * instruction: lerp for translation and scale, and nlerp for rotation, optionally with a correction
+ * of the blend factor that brings nlerp within about 1e-3 radians of slerp.
+ */
+class PoseSampling
+{
+public:
+	enum class Kernel { Scalar, SSE, AVX };
+
+	/**
+	 * @brief The fastest kernel this build was compiled with.
+	 */
+	static Kernel BestKernel();
+	static const char* KernelName(Kernel kernel);
+
+	/**
+	 * @brief Reference implementation, one channel at a time.
+	 * @param a, b the two frame blocks; out receives a block of the same layout.
+	 * @param stride the number of floats per component stream, a multiple of 8.
+	 */
+	static void BlendScalar(const float* a, const float* b, float alpha, size_t stride, bool slerpCorrection, float* out);
+
+	/**
+	 * @brief Blends with the SSE or AVX kernel, falling back to BlendScalar when neither is available.
+	 */
+	static void BlendSimd(const float* a, const float* b, float alpha, size_t stride, bool slerpCorrection, float* out);
+
+	/**
+	 * @brief Resamples a copy of the clip and prints the cost of sampling a whole pose through the
+	 * per-Bone path, the resampled scalar kernel and the resampled SIMD kernel, together with the
+	 * largest difference between the per-Bone and resampled SIMD poses.
+	 */
+	static void Benchmark(const SkeletalAnimation& clip, float framesPerSecond = 30.0f, int iterations = 1000);
+};
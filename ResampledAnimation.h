@@ -0,0 +1,132 @@
+#pragma once
+
+/* Animation channels resampled at a fixed frame rate */
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include "PoseSampling.h"
+
+/**
+ * @brief Every channel of a clip sampled at a fixed rate, so sampling is frame = time * rate and one
+ * blend between two frames, with no key searches. All channels of a frame are stored together, as ten
+ * component streams (translation xyz, rotation xyzw, scale xyz) of one float per channel each, so a
+ * sample sweeps two contiguous blocks of memory with the PoseSampling kernels. Rotations are stored in
+ * the same hemisphere as the previous frame, so a plain linear blend followed by normalization never
+ * takes the long way around.
+ */
+class ResampledAnimation
+{
+public:
+	/*component streams within a frame*/
+	enum Component { TX, TY, TZ, RX, RY, RZ, RW, SX, SY, SZ, COMPONENT_COUNT };
+
+	ResampledAnimation() = default;
+
+	/**
+	 * @param boneIds the bone id of every channel, in the order they are written.
+	 * @param framesPerTick the sampling rate in frames per animation tick.
+	 */
+	ResampledAnimation(const std::vector<int>& boneIds, int frameCount, float framesPerTick)
+		: m_BoneIds(boneIds), m_FrameCount(frameCount), m_FramesPerTick(framesPerTick)
+	{
+		// Pad each stream to whole 8-float blocks.
+		m_Stride = (boneIds.size() + 7) / 8 * 8;
+		m_Frames.assign(m_Stride * COMPONENT_COUNT * frameCount, 0.0f);
+		m_Blended.assign(m_Stride * COMPONENT_COUNT, 0.0f);
+	}
+
+	bool empty() const { return m_FrameCount == 0; }
+	int GetFrameCount() const { return m_FrameCount; }
+	size_t GetChannelCount() const { return m_BoneIds.size(); }
+	size_t GetStride() const { return m_Stride; }
+	const std::vector<int>& GetBoneIds() const { return m_BoneIds; }
+
+	/*replaces every channel's bone id with ids[id]*/
+	void RemapBoneIds(const std::vector<int>& ids)
+	{
+		for (int& id : m_BoneIds)
+			id = ids[id];
+	}
+	size_t GetByteSize() const { return m_Frames.size() * sizeof(float) + m_BoneIds.size() * sizeof(int); }
+
+	/*whether rotations are corrected toward slerp, or left as plain nlerp; on by default*/
+	void SetSlerpCorrection(bool correction) { m_SlerpCorrection = correction; }
+	bool GetSlerpCorrection() const { return m_SlerpCorrection; }
+
+	/*the first float of a frame's block; component k of channel c is at [k * GetStride() + c]*/
+	const float* GetFrame(int frame) const { return &m_Frames[frame * m_Stride * COMPONENT_COUNT]; }
+
+	/*writes one channel of one frame; frames must be written in order*/
+	void SetFrame(int frame, size_t channel, const glm::vec3& translation, glm::quat rotation, const glm::vec3& scale)
+	{
+		float* block = &m_Frames[frame * m_Stride * COMPONENT_COUNT];
+		if (frame > 0)
+		{
+			const float* previous = GetFrame(frame - 1);
+			glm::quat last(previous[RW * m_Stride + channel], previous[RX * m_Stride + channel],
+				previous[RY * m_Stride + channel], previous[RZ * m_Stride + channel]);
+			if (glm::dot(last, rotation) < 0.0f)
+				rotation = -rotation;
+		}
+		float values[COMPONENT_COUNT] = { translation.x, translation.y, translation.z,
+			rotation.x, rotation.y, rotation.z, rotation.w, scale.x, scale.y, scale.z };
+		for (int k = 0; k < COMPONENT_COUNT; k++)
+			block[k * m_Stride + channel] = values[k];
+	}
+
+	/**
+	 * @brief Finds the two frames around animationTime (in ticks) and the blend factor between them.
+	 */
+	void Locate(float animationTime, int& frame, int& next, float& alpha) const
+	{
+		float position = std::max(0.0f, animationTime * m_FramesPerTick);
+		frame = std::min((int)position, m_FrameCount - 1);
+		next = std::min(frame + 1, m_FrameCount - 1);
+		alpha = std::min(1.0f, position - frame);
+	}
+
+	/**
+	 * @brief Calls sample(id, translation, rotation, scale) for every channel at animationTime (in ticks).
+	 */
+	template<class F>
+	void Sample(float animationTime, F&& sample)
+	{
+		Sample(animationTime, sample, m_Blended);
+	}
+
+	/**
+	 * @brief Sample, blending into the caller's scratch instead of the clip's, so several threads can
+	 * sample the same clip at once.
+	 */
+	template<class F>
+	void Sample(float animationTime, F&& sample, std::vector<float>& blended) const
+	{
+		int frame, next;
+		float alpha;
+		Locate(animationTime, frame, next, alpha);
+		blended.resize(m_Stride * COMPONENT_COUNT);
+		PoseSampling::BlendSimd(GetFrame(frame), GetFrame(next), alpha, m_Stride, m_SlerpCorrection, blended.data());
+
+		const float* out = blended.data();
+		for (size_t c = 0; c < m_BoneIds.size(); c++)
+		{
+			auto at = [&](int k) { return out[k * m_Stride + c]; };
+			sample(m_BoneIds[c], glm::vec3(at(TX), at(TY), at(TZ)),
+				glm::quat(at(RW), at(RX), at(RY), at(RZ)),
+				glm::vec3(at(SX), at(SY), at(SZ)));
+		}
+	}
+
+private:
+	std::vector<int> m_BoneIds;
+	std::vector<float> m_Frames;
+	/*the last blended frame, in the same layout*/
+	std::vector<float> m_Blended;
+	bool m_SlerpCorrection = true;
+	size_t m_Stride = 0;
+	int m_FrameCount = 0;
+	float m_FramesPerTick = 0.0f;
+};
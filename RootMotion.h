@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+/**
+ * @brief How far a character's root moved over some time step, in the model space of its clip and
+ * relative to the way the character faced at the start of the step.
+ */
+struct RootMotion
+{
+	glm::vec3 translation = glm::vec3(0.0f);
+	/*rotation about the model's up (y) axis, in radians*/
+	float yaw = 0.0f;
+
+	/*this step followed by next, which starts facing where this one ends*/
+	RootMotion Then(const RootMotion& next) const
+	{
+		RootMotion sum;
+		sum.translation = translation + RotateYaw(next.translation, yaw);
+		sum.yaw = yaw + next.yaw;
+		return sum;
+	}
+
+	/*adds a weighted step, for blends whose weights sum to one*/
+	void Accumulate(const RootMotion& motion, float weight)
+	{
+		translation += motion.translation * weight;
+		yaw += motion.yaw * weight;
+	}
+
+	static glm::vec3 RotateYaw(const glm::vec3& v, float yaw)
+	{
+		float c = std::cos(yaw), s = std::sin(yaw);
+		return glm::vec3(c * v.x + s * v.z, v.y, -s * v.x + c * v.z);
+	}
+};
+
+/**
+ * @brief A clip's root position on the ground plane and its yaw, sampled at a fixed rate, so the root
+ * motion between any two times costs two lookups instead of sampling the root channel again.
+ */
+class RootMotionTrack
+{
+public:
+	RootMotionTrack() = default;
+
+	/**
+	 * @param samplesPerTick the rate AddSample() is called at, from time 0 on.
+	 * @param duration the clip duration, in ticks.
+	 */
+	RootMotionTrack(float samplesPerTick, float duration)
+		: m_SamplesPerTick(samplesPerTick), m_Duration(duration)
+	{
+	}
+
+	/*appends the next sample; yaws are unwrapped, so turning past a half circle keeps counting*/
+	void AddSample(const glm::vec3& position, float yaw)
+	{
+		if (!m_Yaws.empty())
+		{
+			const float pi = glm::pi<float>();
+			float previous = m_Yaws.back();
+			yaw = previous + std::remainder(yaw - previous, 2.0f * pi);
+		}
+		m_Positions.push_back(position);
+		m_Yaws.push_back(yaw);
+	}
+
+	bool empty() const { return m_Positions.empty(); }
+
+	/*the position and yaw at time 0, which stripped poses hold the root at*/
+	const glm::vec3& GetStartPosition() const { return m_Positions.front(); }
+	float GetStartYaw() const { return m_Yaws.front(); }
+
+	/**
+	 * @brief The motion from fromTime to toTime (ticks). wrapped: a looping clip passed its end in between.
+	 */
+	RootMotion Delta(float fromTime, float toTime, bool wrapped) const
+	{
+		if (empty())
+			return RootMotion();
+		if (!wrapped)
+			return Segment(fromTime, toTime);
+		return Segment(fromTime, m_Duration).Then(Segment(0.0f, toTime));
+	}
+
+private:
+	void At(float time, glm::vec3& position, float& yaw) const
+	{
+		float sample = std::clamp(time * m_SamplesPerTick, 0.0f, float(m_Positions.size() - 1));
+		size_t index = std::min((size_t)sample, m_Positions.size() - 1);
+		size_t next = std::min(index + 1, m_Positions.size() - 1);
+		float alpha = sample - float(index);
+		position = glm::mix(m_Positions[index], m_Positions[next], alpha);
+		yaw = m_Yaws[index] + (m_Yaws[next] - m_Yaws[index]) * alpha;
+	}
+
+	RootMotion Segment(float fromTime, float toTime) const
+	{
+		glm::vec3 from, to;
+		float fromYaw, toYaw;
+		At(fromTime, from, fromYaw);
+		At(toTime, to, toYaw);
+		RootMotion motion;
+		// Stripped poses face the start yaw, so the step is expressed relative to the yaw turned so far.
+		motion.translation = RootMotion::RotateYaw(to - from, -(fromYaw - m_Yaws.front()));
+		motion.yaw = toYaw - fromYaw;
+		return motion;
+	}
+
+	float m_SamplesPerTick = 0.0f;
+	float m_Duration = 0.0f;
+	std::vector<glm::vec3> m_Positions;
+	std::vector<float> m_Yaws;
+};
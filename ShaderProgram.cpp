@@ -119,6 +119,52 @@ void ShaderProgram::load(const char* vertexPath, const char* fragmentPath, const
 
 }
 
+void ShaderProgram::loadTransformFeedback(const char* vertexPath, const std::vector<const char*>& varyings)
+{
+    std::string vertexCode;
+    std::ifstream vShaderFile;
+    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try
+    {
+        vShaderFile.open(vertexPath);
+        std::stringstream vShaderStream;
+        vShaderStream << vShaderFile.rdbuf();
+        vShaderFile.close();
+        vertexCode = vShaderStream.str();
+    }
+    catch (std::ifstream::failure& e)
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
+    }
+    const char* vShaderCode = vertexCode.c_str();
+    int success;
+    char infoLog[512];
+
+    unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(vertex, 1, &vShaderCode, NULL);
+    glCompileShader(vertex);
+    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
+        throw std::runtime_error(infoLog);
+    };
+
+    // The captured varyings must be declared before linking; there is no fragment stage, since
+    // the program is only ever used with GL_RASTERIZER_DISCARD enabled.
+    m_programId = glCreateProgram();
+    glAttachShader(m_programId, vertex);
+    glTransformFeedbackVaryings(m_programId, varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(m_programId);
+    glGetProgramiv(m_programId, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        glGetProgramInfoLog(m_programId, 512, NULL, infoLog);
+        throw std::runtime_error(infoLog);
+    }
+    glDeleteShader(vertex);
+}
+
 
 //void ShaderProgram::load(const std::string& vertexShaderPath, const std::string& fragmentShaderPath)
 //{
@@ -248,3 +294,13 @@ void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat4&
 {
     glUniformMatrix4fv(glGetUniformLocation(m_programId, uniformName.c_str()), 1, false, &value[0][0]);
 }
+
+void ShaderProgram::setUniform(const std::string& uniformName, const int32_t* values, size_t count)
+{
+    glUniform1iv(glGetUniformLocation(m_programId, uniformName.c_str()), (GLsizei)count, values);
+}
+
+void ShaderProgram::setUniform(const std::string& uniformName, const glm::mat4* values, size_t count)
+{
+    glUniformMatrix4fv(glGetUniformLocation(m_programId, uniformName.c_str()), (GLsizei)count, false, &values[0][0][0]);
+}
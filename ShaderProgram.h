@@ -1,6 +1,7 @@
 #pragma once
 #include <glm/ext.hpp>
 #include <string>
+#include <vector>
 class ShaderProgram {
 	uint32_t m_programId;
 
@@ -19,11 +20,18 @@ public:
 	void setUniform(const std::string& uniformName, const glm::mat2& value);
 	void setUniform(const std::string& uniformName, const glm::mat3& value);
 	void setUniform(const std::string& uniformName, const glm::mat4& value);
+	// Arrays: sets elements [0, count) of an array uniform in one call.
+	void setUniform(const std::string& uniformName, const int32_t* values, size_t count);
+	void setUniform(const std::string& uniformName, const glm::mat4* values, size_t count);
 
 
 
 
 
 	void load(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
+
+	// Loads a vertex-only program whose outputs are captured into a buffer with transform feedback,
+	// one interleaved record per vertex in the order of the given varyings.
+	void loadTransformFeedback(const char* vertexPath, const std::vector<const char*>& varyings);
     
 };
\ No newline at end of file
@@ -7,7 +7,8 @@
 const size_t FLOATS_PER_VERTEX = 3;
 const size_t VERTICES_PER_FACE = 3;
 
-Skeletal::Skeletal(const std::string& path, bool flipTextureCoords) {
+Skeletal::Skeletal(const std::string& path, bool flipTextureCoords, int maxInfluences)
+	: m_MaxInfluences(std::clamp(maxInfluences, 1, MAX_BONE_PER_VERTEX)) {
 	m_root = s_assimpLoad(path, flipTextureCoords);
 }
 
@@ -35,39 +36,93 @@ std::vector<Texture> s_loadMaterialTextures(aiMaterial* mat, aiTextureType type,
 	return textures;
 }
 
-void SetVertexBoneData(SkeletalVertex& vertex, int boneID, float weight)
+/*keeps the strongest maxInfluences of a vertex's (weight, bone) pairs, sorted, and renormalizes them to sum to 1*/
+void SetVertexBoneData(SkeletalVertex& vertex, std::vector<std::pair<float, int>>& influences, int maxInfluences)
 {
-	for (int i = 0; i < MAX_BONE_PER_VERTEX; ++i)
+	size_t count = std::min(influences.size(), (size_t)maxInfluences);
+	std::partial_sort(influences.begin(), influences.begin() + count, influences.end(),
+		[](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first > b.first; });
+	float total = 0.0f;
+	for (size_t i = 0; i < count; ++i)
+		total += influences[i].first;
+	for (size_t i = 0; i < count; ++i)
 	{
-		if (vertex.m_BoneIDs[i] < 0)
+		vertex.m_Weights[i] = influences[i].first / total;
+		vertex.m_BoneIDs[i] = influences[i].second;
+	}
+}
+
+void Skeletal::ReadBoneInfo(const aiScene* scene)
+{
+	std::unordered_map<std::string, glm::mat4> offsets;
+	std::unordered_set<std::string> influencing;
+	for (unsigned int meshIndex = 0; meshIndex < scene->mNumMeshes; ++meshIndex)
+	{
+		const aiMesh* mesh = scene->mMeshes[meshIndex];
+		for (unsigned int boneIndex = 0; boneIndex < mesh->mNumBones; ++boneIndex)
 		{
-			vertex.m_Weights[i] = weight;
-			vertex.m_BoneIDs[i] = boneID;
-			break;
+			const aiBone* bone = mesh->mBones[boneIndex];
+			std::string boneName = bone->mName.C_Str();
+			offsets.insert({ boneName, AssimpGLMHelpers::ConvertMatrixToGLMFormat(bone->mOffsetMatrix) });
+			for (unsigned int weightIndex = 0; weightIndex < bone->mNumWeights; ++weightIndex)
+			{
+				if (bone->mWeights[weightIndex].mWeight > 0.0f)
+				{
+					influencing.insert(boneName);
+					break;
+				}
+			}
 		}
 	}
+
+	std::unordered_set<std::string> keep;
+	MarkUsedBones(scene->mRootNode, offsets, influencing, keep);
+	AssignBoneIds(scene->mRootNode, offsets, keep);
+	std::cout << "Bones: " << m_BoneCounter << " of " << offsets.size() << " kept\n";
+}
+
+bool Skeletal::MarkUsedBones(const aiNode* node, const std::unordered_map<std::string, glm::mat4>& offsets,
+	const std::unordered_set<std::string>& influencing, std::unordered_set<std::string>& keep)
+{
+	bool used = influencing.count(node->mName.C_Str()) > 0;
+	for (unsigned int i = 0; i < node->mNumChildren; ++i)
+	{
+		// no short circuit: every child subtree has to be marked
+		used = MarkUsedBones(node->mChildren[i], offsets, influencing, keep) || used;
+	}
+	if (used && offsets.count(node->mName.C_Str()))
+		keep.insert(node->mName.C_Str());
+	return used;
+}
+
+void Skeletal::AssignBoneIds(const aiNode* node, const std::unordered_map<std::string, glm::mat4>& offsets,
+	const std::unordered_set<std::string>& keep)
+{
+	std::string name = node->mName.C_Str();
+	if (keep.count(name) && m_BoneInfoMap.find(name) == m_BoneInfoMap.end())
+	{
+		BoneInfo newBoneInfo;
+		newBoneInfo.id = m_BoneCounter;
+		newBoneInfo.offset = offsets.at(name);
+		m_BoneInfoMap[name] = newBoneInfo;
+		m_BoneCounter++;
+	}
+	for (unsigned int i = 0; i < node->mNumChildren; ++i)
+		AssignBoneIds(node->mChildren[i], offsets, keep);
 }
 
 void Skeletal::ExtractBoneWeightForVertices(std::vector<SkeletalVertex>& vertices, const aiMesh* mesh, const aiScene* scene)
 {
+	// every weight of every vertex, before choosing which ones to keep
+	std::vector<std::vector<std::pair<float, int>>> influences(vertices.size());
 	for (int boneIndex = 0; boneIndex < mesh->mNumBones; ++boneIndex)
 	{
-		int boneID = -1;
 		std::string boneName = mesh->mBones[boneIndex]->mName.C_Str();
-		if (m_BoneInfoMap.find(boneName) == m_BoneInfoMap.end())
-		{
-			BoneInfo newBoneInfo;
-			newBoneInfo.id = m_BoneCounter;
-			newBoneInfo.offset = AssimpGLMHelpers::ConvertMatrixToGLMFormat(mesh->mBones[boneIndex]->mOffsetMatrix);
-			m_BoneInfoMap[boneName] = newBoneInfo;
-			boneID = m_BoneCounter;
-			m_BoneCounter++;
-		}
-		else
-		{
-			boneID = m_BoneInfoMap[boneName].id;
-		}
-		assert(boneID != -1);
+		auto boneInfo = m_BoneInfoMap.find(boneName);
+		// pruned by ReadBoneInfo: the bone skins nothing
+		if (boneInfo == m_BoneInfoMap.end())
+			continue;
+		int boneID = boneInfo->second.id;
 		auto weights = mesh->mBones[boneIndex]->mWeights;
 		int numWeights = mesh->mBones[boneIndex]->mNumWeights;
 
@@ -76,12 +131,19 @@ void Skeletal::ExtractBoneWeightForVertices(std::vector<SkeletalVertex>& vertice
 			int vertexId = weights[weightIndex].mVertexId;
 			float weight = weights[weightIndex].mWeight;
 			assert(vertexId <= vertices.size());
-			SetVertexBoneData(vertices[vertexId], boneID, weight);
+			if (weight > 0.0f)
+				influences[vertexId].push_back({ weight, boneID });
 		}
 	}
+
+	for (size_t vertexId = 0; vertexId < vertices.size(); ++vertexId)
+	{
+		if (!influences[vertexId].empty())
+			SetVertexBoneData(vertices[vertexId], influences[vertexId], m_MaxInfluences);
+	}
 }
 
-SkeletalMesh Skeletal::s_fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::filesystem::path& modelPath,
+std::vector<SkeletalMesh> Skeletal::s_fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::filesystem::path& modelPath,
 	std::unordered_map<std::filesystem::path, Texture>& loadedTextures) {
 	std::vector<SkeletalVertex> vertices;
 
@@ -143,8 +205,8 @@ SkeletalMesh Skeletal::s_fromAssimpMesh(const aiMesh* mesh, const aiScene* scene
 	ExtractBoneWeightForVertices(vertices, mesh, scene);
 
 
-	auto m = SkeletalMesh(std::move(vertices), std::move(faces), std::move(textures));
-	return m;
+	// Meshes referencing more bones than a draw can upload become several meshes.
+	return SkeletalMesh::splitByPalette(std::move(vertices), std::move(faces), std::move(textures));
 }
 
 SkeletalObject Skeletal::s_processAssimpNode(aiNode* node, const aiScene* scene,
@@ -157,7 +219,9 @@ SkeletalObject Skeletal::s_processAssimpNode(aiNode* node, const aiScene* scene,
 	std::vector<SkeletalMesh> meshes;
 	for (auto i = 0; i < node->mNumMeshes; i++) {
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.emplace_back(s_fromAssimpMesh(mesh, scene, modelPath, loadedTextures));
+		for (auto& part : s_fromAssimpMesh(mesh, scene, modelPath, loadedTextures)) {
+			meshes.push_back(std::move(part));
+		}
 	}
 
 	std::vector<Texture> textures;
@@ -186,7 +250,8 @@ SkeletalObject Skeletal::s_assimpLoad(const std::string& path, bool flipTextureC
 
 	Assimp::Importer importer;
 	// add: calculate tangent
-	auto options = aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_CalcTangentSpace;
+	// Bone weights are limited by ExtractBoneWeightForVertices, which may keep more than Assimp's four.
+	auto options = (aiProcessPreset_TargetRealtime_MaxQuality | aiProcess_CalcTangentSpace) & ~aiProcess_LimitBoneWeights;
 	if (flipTextureCoords) {
 		options |= aiProcess_FlipUVs;
 	}
@@ -198,6 +263,8 @@ SkeletalObject Skeletal::s_assimpLoad(const std::string& path, bool flipTextureC
 
 	}
 
+	ReadBoneInfo(scene);
+
 	std::vector<SkeletalMesh> meshes;
 	std::unordered_map<std::filesystem::path, Texture> loadedTextures;
 
@@ -7,25 +7,34 @@
 #include <assimp/postprocess.h>
 #include <filesystem>
 #include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
 
 class Skeletal
 {
 public:
-	Skeletal(const std::string& path, bool flipTextureCoords);
+	/**
+	 * @param maxInfluences the most bones kept per vertex, 4 or up to MAX_BONE_PER_VERTEX: the strongest
+	 * weights are kept and renormalized. Only meshes that end up needing more than 4 pay for 8 on the GPU.
+	 */
+	Skeletal(const std::string& path, bool flipTextureCoords, int maxInfluences = 4);
 
 
 	SkeletalObject& getRoot() { return m_root; }
+	const SkeletalObject& getRoot() const { return m_root; }
 
 
 	auto& GetBoneInfoMap() { return m_BoneInfoMap; }
+	const auto& GetBoneInfoMap() const { return m_BoneInfoMap; }
 	int& GetBoneCount() { return m_BoneCounter; }
+	int GetBoneCount() const { return m_BoneCounter; }
 
 
 private:
 	SkeletalObject m_root;
 	std::unordered_map<std::string, BoneInfo> m_BoneInfoMap;
 	int m_BoneCounter = 0;
+	int m_MaxInfluences = 4;
 
 
 	SkeletalObject s_assimpLoad(const std::string& path, bool flipTextureCoords);
@@ -34,9 +43,22 @@ private:
 		const std::filesystem::path& modelPath,
 		std::unordered_map<std::filesystem::path, Texture>& loadedTextures);
 
-	SkeletalMesh s_fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::filesystem::path& modelPath,
+	std::vector<SkeletalMesh> s_fromAssimpMesh(const aiMesh* mesh, const aiScene* scene, const std::filesystem::path& modelPath,
 		std::unordered_map<std::filesystem::path, Texture>& loadedTextures);
 
+	/**
+	 * @brief Assigns bone ids before any mesh is built, keeping only the bones that skin a vertex or
+	 * have a descendant that does; ids are compact and follow the node hierarchy depth-first.
+	 */
+	void ReadBoneInfo(const aiScene* scene);
+
+	/*marks in keep every skinning bone at or below node that is needed; true if any is*/
+	bool MarkUsedBones(const aiNode* node, const std::unordered_map<std::string, glm::mat4>& offsets,
+		const std::unordered_set<std::string>& influencing, std::unordered_set<std::string>& keep);
+
+	void AssignBoneIds(const aiNode* node, const std::unordered_map<std::string, glm::mat4>& offsets,
+		const std::unordered_set<std::string>& keep);
+
 	void ExtractBoneWeightForVertices(std::vector<SkeletalVertex>& vertices, const aiMesh* mesh, const aiScene* scene);
 
 };
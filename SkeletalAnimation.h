@@ -2,11 +2,22 @@
 
 #include <vector>
 #include <map>
+#include <unordered_set>
+#include <limits>
+#include <climits>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 #include "Bone.h"
 #include "BoneInfo.h"
 #include "Skeletal.h"
+#include "SkeletalPose.h"
+#include "KeyframeCompression.h"
+#include "ResampledAnimation.h"
+#include "HierarchyCompose.h"
+#include "RootMotion.h"
+#include "BoneMask.h"
+#include "AnimationEvents.h"
 
 struct AssimpNodeData
 {
@@ -16,31 +27,47 @@ struct AssimpNodeData
 	std::vector<AssimpNodeData> children;
 };
 
+/**
+ * @brief Scratch space for sampling and composing a SkeletalAnimation. The clip's own scratch is shared,
+ * so threads evaluating the same clip concurrently each bring one of these.
+ */
+struct PoseWorkspace
+{
+	/*a blended frame of a resampled clip*/
+	std::vector<float> blended;
+	/*the global transform of every hierarchy node*/
+	std::vector<glm::mat4> globals;
+};
+
 class SkeletalAnimation
 {
 public:
 	SkeletalAnimation() = default;
 
-	SkeletalAnimation(const std::string& animationPath, Skeletal* model)
+	/*clips only need the node hierarchy and the channels, so none of the mesh post-processing runs*/
+	static constexpr unsigned int IMPORT_FLAGS = aiProcess_ValidateDataStructure;
+
+	/**
+	 * @brief Imports the clip at clipIndex from the file. To use several clips of one file, AnimationLibrary
+	 * imports it once for all of them.
+	 */
+	SkeletalAnimation(const std::string& animationPath, Skeletal* model, unsigned int clipIndex = 0)
 	{
 		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(animationPath, aiProcessPreset_TargetRealtime_MaxQuality);
-		assert(scene && scene->mRootNode);
+		const aiScene* scene = importer.ReadFile(animationPath, IMPORT_FLAGS);
+		assert(scene && scene->mRootNode && clipIndex < scene->mNumAnimations);
 
 		std::cout << "Animation count: " << scene->mNumAnimations << "\n";
 
-		auto animation = scene->mAnimations[0];
-
-		m_Duration = animation->mDuration;
-		m_TicksPerSecond = animation->mTicksPerSecond;
-		ReadHierarchyData(m_RootNode, scene->mRootNode);
-		ReadMissingBones(animation, *model);
-
-
-		bone_size = model->GetBoneCount();
-		std::cout << "Bone count: " << model->GetBoneCount() << "\n";
+		ReadAnimation(scene, scene->mAnimations[clipIndex], model);
+	}
 
-		//std::cout << "Size: " << getBonesSize() << "\n";
+	/**
+	 * @brief Reads one clip of a scene that is already imported.
+	 */
+	SkeletalAnimation(const aiScene* scene, const aiAnimation* animation, Skeletal* model)
+	{
+		ReadAnimation(scene, animation, model);
 	}
 
 	~SkeletalAnimation()
@@ -64,6 +91,7 @@ public:
 	}
 
 
+	inline const std::string& GetName() const { return m_Name; }
 	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
 	inline float GetDuration() { return m_Duration; }
 	inline const AssimpNodeData& GetRootNode() { return m_RootNode; }
@@ -73,8 +101,435 @@ public:
 	}
 
 	inline int getBonesSize() { return bone_size; }
+	inline const glm::mat4& GetGlobalInverseTransform() { return m_GlobalInverseTransform; }
+
+	/*the fixed-rate channels after Resample(), empty otherwise*/
+	inline ResampledAnimation& GetResampled() { return m_Resampled; }
+
+	/*the hierarchy's own node transforms as a pose; bones without a channel in this clip keep these*/
+	inline const SkeletalPose& GetBindPose() { return m_BindPose; }
+
+	/**
+	 * @brief Samples every channel of the clip at the given time (in ticks) into pose.
+	 */
+	void SamplePose(float animationTime, SkeletalPose& pose)
+	{
+		pose = m_BindPose;
+		SampleChannels(animationTime, [&pose](int id, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+		{
+			pose.translations[id] = translation;
+			pose.rotations[id] = rotation;
+			pose.scales[id] = scale;
+		});
+	}
+
+	/**
+	 * @brief SamplePose with the caller's scratch space, so several threads can sample the clip at once.
+	 * Channels of bones deeper than maxBoneDepth are skipped (see ComposePose), except in resampled
+	 * clips, which blend all channels in one sweep.
+	 */
+	void SamplePose(float animationTime, SkeletalPose& pose, PoseWorkspace& workspace, int maxBoneDepth = INT_MAX)
+	{
+		pose = m_BindPose;
+		SampleChannels(animationTime, [&pose](int id, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+		{
+			pose.translations[id] = translation;
+			pose.rotations[id] = rotation;
+			pose.scales[id] = scale;
+		}, maxBoneDepth, &workspace.blended);
+	}
+
+	/**
+	 * @brief SamplePose for the bones of mask only: calls sample(id, translation, rotation, scale) for every
+	 * masked bone the clip has a channel for. Channels outside the mask are skipped before any key search,
+	 * so a partial-body layer costs in proportion to its bones, except in resampled clips, which blend
+	 * all channels in one sweep and pass on the masked ones.
+	 */
+	template<class F>
+	void SampleMasked(float animationTime, const BoneMask& mask, PoseWorkspace& workspace, F&& sample)
+	{
+		auto included = [&mask](int id) { return mask.Contains(id); };
+		SampleChannelsIf(animationTime, [&](int id, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+		{
+			if (included(id))
+				sample(id, translation, rotation, scale);
+		}, included, &workspace.blended);
+	}
+
+	/**
+	 * @brief A mask of weight for the named bone and every bone below it, e.g. the spine for an upper-body
+	 * layer. Empty if the clip's hierarchy has no such node.
+	 */
+	BoneMask GetBranchMask(const std::string& boneName, float weight = 1.0f) const
+	{
+		BoneMask mask;
+		ReadBranchMask(m_RootNode, boneName, weight, false, mask);
+		return mask;
+	}
+
+	/**
+	 * @brief Turns the clip into an additive one: every key becomes its delta against reference (see
+	 * SkeletalPose::MakeAdditive), for layering over other clips with SkeletalAnimator::addLayer. Call it
+	 * before Compress() or Resample(), which then store the deltas. Additive clips have no root motion.
+	 */
+	void MakeAdditive(const SkeletalPose& reference)
+	{
+		if (m_Bones.empty() && (!m_CompressedBones.empty() || !m_Resampled.empty()))
+		{
+			std::cout << "ERROR::ANIMATION: " << m_Name << " must be made additive before it is compressed or resampled\n";
+			return;
+		}
+		if (m_Additive)
+			return;
+		for (auto& [name, bone] : m_Bones)
+		{
+			int id = bone.GetBoneID();
+			if (id >= 0 && id < (int)reference.size())
+				bone.MakeAdditive(reference.translations[id], reference.rotations[id], reference.scales[id]);
+		}
+		// Bones without a channel add nothing.
+		m_Additive = true;
+		m_RootMotionBone = -1;
+		ReadSkeleton();
+	}
+
+	bool IsAdditive() const { return m_Additive; }
+
+	/**
+	 * @brief Whether the clip drives model as it is: every bone of model has the same id and offset here.
+	 * Holds for every model imported from the same file, so they can all share the clip.
+	 */
+	bool IsCompatible(Skeletal& model) const
+	{
+		for (auto& [name, info] : model.GetBoneInfoMap())
+		{
+			auto found = m_BoneInfoMap.find(name);
+			if (found == m_BoneInfoMap.end() || found->second.id != info.id || found->second.offset != info.offset)
+				return false;
+		}
+		return true;
+	}
+
+	/**
+	 * @brief A copy of the clip for a model whose rig has the same bone names, but possibly other ids
+	 * and offsets: channels move to the model's ids, and bones the model lacks are added to it, as at import.
+	 * The node hierarchy stays the clip's own, so the rigs should also agree on their rest pose.
+	 */
+	SkeletalAnimation RemapTo(Skeletal& model) const
+	{
+		auto& boneInfoMap = model.GetBoneInfoMap();
+		int& boneCount = model.GetBoneCount();
+		std::vector<int> ids(bone_size, -1);
+		for (auto& [name, info] : m_BoneInfoMap)
+		{
+			auto found = boneInfoMap.find(name);
+			if (found == boneInfoMap.end())
+			{
+				found = boneInfoMap.insert({ name, BoneInfo{ boneCount, info.offset } }).first;
+				boneCount++;
+			}
+			if (info.id >= 0 && info.id < bone_size)
+				ids[info.id] = found->second.id;
+		}
+
+		SkeletalAnimation remapped = *this;
+		for (auto& [name, bone] : remapped.m_Bones)
+			bone.SetBoneID(ids[bone.GetBoneID()]);
+		for (auto& bone : remapped.m_CompressedBones)
+			bone.SetBoneID(ids[bone.GetBoneID()]);
+		remapped.m_Resampled.RemapBoneIds(ids);
+		if (m_RootMotionBone >= 0)
+			remapped.m_RootMotionBone = ids[m_RootMotionBone];
+		remapped.m_BoneInfoMap = boneInfoMap;
+		remapped.bone_size = boneCount;
+		remapped.ReadSkeleton();
+		return remapped;
+	}
+
+	/*the number of bones ComposePose prunes at maxBoneDepth*/
+	int CountPrunedBones(int maxBoneDepth)
+	{
+		return (int)std::count_if(m_BoneDepths.begin(), m_BoneDepths.end(), [maxBoneDepth](int depth) { return depth > maxBoneDepth; });
+	}
+
+	/**
+	 * @brief Adds the clip sampled at animationTime, scaled by weight, into an accumulator pose
+	 * prepared with SkeletalPose::ClearWeighted. Lets a blend graph sum any number of clips into one pose.
+	 */
+	void AccumulatePose(float animationTime, float weight, SkeletalPose& accumulator)
+	{
+		for (int id : m_StaticBones)
+			accumulator.AccumulateBone(id, m_BindPose.translations[id], m_BindPose.rotations[id], m_BindPose.scales[id], weight);
+		SampleChannels(animationTime, [&accumulator, weight](int id, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+		{
+			accumulator.AccumulateBone(id, translation, rotation, scale, weight);
+		});
+	}
+
+	/**
+	 * @brief Replaces the clip's keys with compressed channels (see KeyframeCompression.h): constant
+	 * channels become one value, keys that interpolation rebuilds within tolerance are dropped, and the
+	 * rest are quantized. Prints and returns the memory before and after, and the largest error against
+	 * Bone::Update. Bones are no longer available through FindBone afterwards.
+	 */
+	KeyframeCompressionReport Compress(const KeyframeCompressionSettings& settings = KeyframeCompressionSettings())
+	{
+		KeyframeCompressionReport report;
+		for (auto& [name, bone] : m_Bones)
+		{
+			CompressedBone compressed(bone, settings);
+			report.rawKeys += bone.GetPositionKeys().size() + bone.GetRotationKeys().size() + bone.GetScaleKeys().size();
+			report.rawBytes += bone.GetPositionKeys().size() * sizeof(KeyPosition) + bone.GetRotationKeys().size() * sizeof(KeyRotation)
+				+ bone.GetScaleKeys().size() * sizeof(KeyScale);
+			report.compressedKeys += compressed.GetKeyCount();
+			report.compressedBytes += compressed.GetByteSize();
+
+			// Compare at every key and halfway between keys; Bone samples up to its earliest last key.
+			float end = std::numeric_limits<float>::max();
+			std::vector<float> times;
+			auto addTimes = [&](auto& keys)
+			{
+				if (keys.size() > 1)
+					end = std::min(end, keys.back().timeStamp);
+				for (size_t i = 0; i < keys.size(); i++)
+				{
+					times.push_back(keys[i].timeStamp);
+					if (i + 1 < keys.size())
+						times.push_back((keys[i].timeStamp + keys[i + 1].timeStamp) * 0.5f);
+				}
+			};
+			addTimes(bone.GetPositionKeys());
+			addTimes(bone.GetRotationKeys());
+			addTimes(bone.GetScaleKeys());
+
+			for (float time : times)
+			{
+				if (time >= end)
+					continue;
+				bone.Update(time);
+				glm::mat4 expected = bone.GetLocalTransform();
+				glm::mat4 actual = glm::translate(glm::mat4(1.0f), compressed.SamplePosition(time))
+					* glm::toMat4(compressed.SampleRotation(time))
+					* glm::scale(glm::mat4(1.0f), compressed.SampleScale(time));
+				report.maxTranslationError = std::max(report.maxTranslationError, glm::length(glm::vec3(expected[3] - actual[3])));
+				for (int c = 0; c < 3; c++)
+					report.maxRotationScaleError = std::max(report.maxRotationScaleError, glm::length(glm::vec3(expected[c] - actual[c])));
+			}
+
+			m_CompressedBones.push_back(std::move(compressed));
+		}
+		m_Bones.clear();
+
+		std::cout << "Compressed animation: " << report.rawKeys << " -> " << report.compressedKeys << " keys, "
+			<< report.rawBytes / 1024.0f << " KB -> " << report.compressedBytes / 1024.0f << " KB\n"
+			<< "  max translation error: " << report.maxTranslationError
+			<< ", max rotation/scale error: " << report.maxRotationScaleError << "\n";
+		return report;
+	}
+
+	/**
+	 * @brief Composes the pose down the hierarchy into the final bone matrices.
+	 * This is the only place where per-bone matrices are built.
+	 */
+	void ComposePose(const SkeletalPose& pose, std::vector<glm::mat4>& finalBoneMatrices, int maxBoneDepth = INT_MAX)
+	{
+		HierarchyCompose::Compose(m_Hierarchy, m_GlobalInverseTransform, pose, m_Globals, finalBoneMatrices, maxBoneDepth);
+	}
+
+	/**
+	 * @brief ComposePose with the caller's scratch space, so several threads can compose with the clip at once.
+	 */
+	void ComposePose(const SkeletalPose& pose, std::vector<glm::mat4>& finalBoneMatrices, PoseWorkspace& workspace, int maxBoneDepth = INT_MAX)
+	{
+		HierarchyCompose::Compose(m_Hierarchy, m_GlobalInverseTransform, pose, workspace.globals, finalBoneMatrices, maxBoneDepth);
+	}
+
+	/**
+	 * @brief The recursive walk that ComposePose replaced, kept as the reference to verify it against.
+	 */
+	void ComposePoseRecursive(const SkeletalPose& pose, std::vector<glm::mat4>& finalBoneMatrices)
+	{
+		ComposeNode(&m_RootNode, glm::mat4(1.0f), pose, finalBoneMatrices);
+	}
+
+	/**
+	 * @brief Replaces the clip's channels with samples taken at a fixed rate (see ResampledAnimation),
+	 * so sampling needs no key searches. Costs more memory than the keys for sparse channels.
+	 */
+	void Resample(float framesPerSecond = 30.0f)
+	{
+		std::vector<int> boneIds;
+		SampleChannels(0.0f, [&boneIds](int id, const glm::vec3&, const glm::quat&, const glm::vec3&)
+		{
+			boneIds.push_back(id);
+		});
+
+		float framesPerTick = framesPerSecond / m_TicksPerSecond;
+		int frameCount = (int)std::ceil(m_Duration * framesPerTick) + 1;
+		ResampledAnimation resampled(boneIds, frameCount, framesPerTick);
+		for (int frame = 0; frame < frameCount; frame++)
+		{
+			// Channels are sampled in [first, last) key, so the last frame is taken just before the end.
+			float time = std::min(frame / framesPerTick, std::nextafter(m_Duration, 0.0f));
+			size_t channel = 0;
+			SampleChannels(time, [&](int /*id*/, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+			{
+				resampled.SetFrame(frame, channel++, translation, rotation, scale);
+			});
+		}
+
+		m_Bones.clear();
+		m_CompressedBones.clear();
+		m_Resampled = std::move(resampled);
+		std::cout << "Resampled animation: " << frameCount << " frames at " << framesPerSecond << " fps, "
+			<< m_Resampled.GetByteSize() / 1024.0f << " KB\n";
+	}
+
+	/**
+	 * @brief Moves the root bone's travel on the ground plane, and its turning about the up axis if
+	 * extractYaw, out of the poses and into a track sampled at samplesPerSecond. Sampled poses then keep
+	 * the root where it starts, and GetRootMotion() tells the owner how far to move the character
+	 * instead (see SkeletalObject::addRootMotion). Affects every player of the clip.
+	 */
+	void EnableRootMotion(bool extractYaw = true, float samplesPerSecond = 60.0f)
+	{
+		if (m_Hierarchy.empty())
+			return;
+		// The first baked node is the top bone; its parent chain is constant.
+		const HierarchyNode& root = m_Hierarchy.front();
+		m_RootMotionBone = -1;
+		m_RootSpace = root.hasPrefix ? m_GlobalInverseTransform * root.prefix : m_GlobalInverseTransform;
+		m_RootSpaceInverse = glm::inverse(m_RootSpace);
+		glm::mat3 axes(m_RootSpace);
+		m_RootSpaceRotation = glm::quat_cast(glm::mat3(glm::normalize(axes[0]), glm::normalize(axes[1]), glm::normalize(axes[2])));
+		m_ExtractYaw = extractYaw;
+
+		float samplesPerTick = samplesPerSecond / m_TicksPerSecond;
+		int sampleCount = (int)std::ceil(m_Duration * samplesPerTick) + 1;
+		RootMotionTrack track(samplesPerTick, m_Duration);
+		SkeletalPose pose;
+		for (int i = 0; i < sampleCount; i++)
+		{
+			float time = std::min(i / samplesPerTick, std::nextafter(m_Duration, 0.0f));
+			SamplePose(time, pose);
+			glm::vec3 position = glm::vec3(m_RootSpace * glm::vec4(pose.translations[root.bone], 1.0f));
+			float yaw = extractYaw ? Yaw(m_RootSpaceRotation * pose.rotations[root.bone]) : 0.0f;
+			track.AddSample(glm::vec3(position.x, 0.0f, position.z), yaw);
+		}
+		m_RootMotion = std::move(track);
+		m_RootMotionBone = root.bone;
+	}
+
+	bool HasRootMotion() const { return m_RootMotionBone >= 0; }
+
+	/**
+	 * @brief Adds an event at time (ticks) to the clip's track. Times at or past the end fire as the clip ends.
+	 */
+	void AddEvent(float time, int id, float value = 0.0f)
+	{
+		m_Events.add(std::clamp(time, 0.0f, std::nextafter(m_Duration, 0.0f)), id, value);
+	}
+
+	const AnimationEventTrack& GetEvents() const { return m_Events; }
+
+	/**
+	 * @brief The root motion from fromTime to toTime (ticks), zero unless EnableRootMotion() was called.
+	 * wrapped: a looping player passed the end of the clip in between.
+	 */
+	RootMotion GetRootMotion(float fromTime, float toTime, bool wrapped) const
+	{
+		return HasRootMotion() ? m_RootMotion.Delta(fromTime, toTime, wrapped) : RootMotion();
+	}
 
 private:
+	/*the angle of q's twist about the y axis*/
+	static float Yaw(const glm::quat& q)
+	{
+		return 2.0f * std::atan2(q.y, q.w);
+	}
+
+	/*the root's local transform with the motion in m_RootMotion taken out: held at its start position and yaw*/
+	void StripRootMotion(glm::vec3& translation, glm::quat& rotation) const
+	{
+		glm::vec3 position = glm::vec3(m_RootSpace * glm::vec4(translation, 1.0f));
+		position.x = m_RootMotion.GetStartPosition().x;
+		position.z = m_RootMotion.GetStartPosition().z;
+		translation = glm::vec3(m_RootSpaceInverse * glm::vec4(position, 1.0f));
+		if (m_ExtractYaw)
+		{
+			glm::quat model = m_RootSpaceRotation * rotation;
+			float turned = Yaw(model) - m_RootMotion.GetStartYaw();
+			rotation = glm::inverse(m_RootSpaceRotation) * glm::angleAxis(-turned, glm::vec3(0.0f, 1.0f, 0.0f)) * model;
+		}
+	}
+
+	/*calls sample(id, translation, rotation, scale) for every channel of the clip, in whichever form it is stored*/
+	template<class F>
+	void SampleChannels(float animationTime, F&& fn, int maxBoneDepth = INT_MAX, std::vector<float>* blended = nullptr)
+	{
+		SampleChannelsIf(animationTime, fn, [&](int id) { return maxBoneDepth == INT_MAX || id >= bone_size || m_BoneDepths[id] <= maxBoneDepth; }, blended);
+	}
+
+	/*SampleChannels for the keyed channels whose bone passes included; resampled clips pass every channel*/
+	template<class F, class I>
+	void SampleChannelsIf(float animationTime, F&& fn, I&& included, std::vector<float>* blended)
+	{
+		auto sample = [&](int id, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale)
+		{
+			if (id != m_RootMotionBone)
+				return fn(id, translation, rotation, scale);
+			glm::vec3 strippedTranslation = translation;
+			glm::quat strippedRotation = rotation;
+			StripRootMotion(strippedTranslation, strippedRotation);
+			fn(id, strippedTranslation, strippedRotation, scale);
+		};
+		for (auto& [name, bone] : m_Bones)
+			if (included(bone.GetBoneID()))
+				sample(bone.GetBoneID(), bone.SamplePosition(animationTime), bone.SampleRotation(animationTime), bone.SampleScale(animationTime));
+		for (auto& bone : m_CompressedBones)
+			if (included(bone.GetBoneID()))
+				sample(bone.GetBoneID(), bone.SamplePosition(animationTime), bone.SampleRotation(animationTime), bone.SampleScale(animationTime));
+		if (!m_Resampled.empty())
+		{
+			if (blended)
+				m_Resampled.Sample(animationTime, sample, *blended);
+			else
+				m_Resampled.Sample(animationTime, sample);
+		}
+	}
+
+	void ReadAnimation(const aiScene* scene, const aiAnimation* animation, Skeletal* model)
+	{
+		m_Name = animation->mName.C_Str();
+		m_Duration = animation->mDuration;
+		m_TicksPerSecond = animation->mTicksPerSecond;
+		ReadHierarchyData(m_RootNode, scene->mRootNode);
+		ReadMissingBones(animation, *model);
+
+
+		bone_size = model->GetBoneCount();
+		std::cout << "Bone count: " << model->GetBoneCount() << "\n";
+
+		ReadSkeleton();
+
+		//std::cout << "Size: " << getBonesSize() << "\n";
+	}
+
+	/*derives everything that depends on bone ids from the hierarchy, m_BoneInfoMap and the channels*/
+	void ReadSkeleton()
+	{
+		m_GlobalInverseTransform = glm::inverse(m_RootNode.transformation);
+		m_BindPose = SkeletalPose();
+		m_BindPose.resize(bone_size);
+		if (!m_Additive)
+			ReadBindPose(m_RootNode);
+		ReadStaticBones();
+		m_BoneDepths.assign(bone_size, 0);
+		m_Hierarchy.clear();
+		ReadFlatHierarchy(m_RootNode, -1);
+		m_Hierarchy = HierarchyCompose::Bake(m_Hierarchy, bone_size);
+	}
+
 	void ReadMissingBones(const aiAnimation* animation, Skeletal& model)
 	{
 		int size = animation->mNumChannels;
@@ -84,12 +539,19 @@ private:
 		auto& boneInfoMap = model.GetBoneInfoMap();//getting m_BoneInfoMap from Model class
 		int& boneCount = model.GetBoneCount(); //getting the m_BoneCounter from Model class
 
+		// channels of nodes with no skinning bone at or below them move nothing visible: skip them
+		// instead of growing the palette (the model pruned such bones at import, see Skeletal::ReadBoneInfo)
+		std::unordered_set<std::string> needed;
+		ReadNeededNodes(m_RootNode, boneInfoMap, needed);
+
 		//reading channels(bones engaged in an animation and their keyframes)
 		for (int i = 0; i < size; i++)
 		{
 			auto channel = animation->mChannels[i];
 			std::string boneName = channel->mNodeName.data;
 
+			if (!needed.count(boneName))
+				continue;
 			if (boneInfoMap.find(boneName) == boneInfoMap.end())
 			{
 				boneInfoMap[boneName].id = boneCount;
@@ -102,6 +564,120 @@ private:
 		m_BoneInfoMap = boneInfoMap;
 	}
 
+	/*collects the nodes that are bones of boneInfoMap or ancestors of one; true if node is either*/
+	bool ReadNeededNodes(const AssimpNodeData& node, const std::unordered_map<std::string, BoneInfo>& boneInfoMap,
+		std::unordered_set<std::string>& needed)
+	{
+		bool used = boneInfoMap.count(node.name) > 0;
+		for (auto& child : node.children)
+			used = ReadNeededNodes(child, boneInfoMap, needed) || used;
+		if (used)
+			needed.insert(node.name);
+		return used;
+	}
+
+	/*sets weight on the bones at and below the node named boneName*/
+	void ReadBranchMask(const AssimpNodeData& node, const std::string& boneName, float weight, bool inside, BoneMask& mask) const
+	{
+		inside = inside || node.name == boneName;
+		if (inside)
+		{
+			auto boneInfo = m_BoneInfoMap.find(node.name);
+			if (boneInfo != m_BoneInfoMap.end() && boneInfo->second.id < bone_size)
+				mask.Set(boneInfo->second.id, weight);
+		}
+		for (auto& child : node.children)
+			ReadBranchMask(child, boneName, weight, inside, mask);
+	}
+
+	void ComposeNode(const AssimpNodeData* node, const glm::mat4& parentTransform,
+		const SkeletalPose& pose, std::vector<glm::mat4>& finalBoneMatrices)
+	{
+		auto boneInfo = m_BoneInfoMap.find(node->name);
+		bool isBone = boneInfo != m_BoneInfoMap.end() && boneInfo->second.id < (int)pose.size();
+
+		glm::mat4 nodeTransform = isBone ? pose.LocalTransform(boneInfo->second.id) : node->transformation;
+		glm::mat4 globalTransformation = parentTransform * nodeTransform;
+
+		if (isBone)
+		{
+			int index = boneInfo->second.id;
+			finalBoneMatrices[index] = m_GlobalInverseTransform * globalTransformation * boneInfo->second.offset;
+		}
+
+		for (int i = 0; i < node->childrenCount; i++)
+			ComposeNode(&node->children[i], globalTransformation, pose, finalBoneMatrices);
+	}
+
+	/*decomposes the node transforms of bones once at load, so unanimated bones can live in a pose*/
+	void ReadBindPose(const AssimpNodeData& node)
+	{
+		auto boneInfo = m_BoneInfoMap.find(node.name);
+		if (boneInfo != m_BoneInfoMap.end() && boneInfo->second.id < bone_size)
+		{
+			int id = boneInfo->second.id;
+			const glm::mat4& m = node.transformation;
+			glm::vec3 scale(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2])));
+			m_BindPose.translations[id] = glm::vec3(m[3]);
+			m_BindPose.scales[id] = scale;
+			m_BindPose.rotations[id] = glm::normalize(glm::quat_cast(
+				glm::mat3(glm::vec3(m[0]) / scale.x, glm::vec3(m[1]) / scale.y, glm::vec3(m[2]) / scale.z)));
+		}
+		for (auto& child : node.children)
+			ReadBindPose(child);
+	}
+
+	/*bones without a channel in this clip, which always hold their bind pose*/
+	void ReadStaticBones()
+	{
+		std::vector<bool> animated(bone_size, false);
+		auto mark = [&](int id) { if (id >= 0 && id < bone_size) animated[id] = true; };
+		for (auto& [name, bone] : m_Bones)
+			mark(bone.GetBoneID());
+		for (auto& bone : m_CompressedBones)
+			mark(bone.GetBoneID());
+		for (int id : m_Resampled.GetBoneIds())
+			mark(id);
+		m_StaticBones.clear();
+		for (int id = 0; id < bone_size; id++)
+			if (!animated[id])
+				m_StaticBones.push_back(id);
+	}
+
+	/*flattens the hierarchy depth-first, so every node comes after its parent*/
+	void ReadFlatHierarchy(const AssimpNodeData& node, int parent)
+	{
+		HierarchyNode flat;
+		flat.parent = parent;
+		flat.bone = -1;
+		flat.parentBone = -1;
+		flat.boneDepth = 0;
+		flat.transformation = node.transformation;
+		flat.offset = glm::mat4(1.0f);
+		flat.prefix = glm::mat4(1.0f);
+		flat.hasPrefix = false;
+		if (parent >= 0)
+		{
+			const HierarchyNode& up = m_Hierarchy[parent];
+			flat.parentBone = up.bone >= 0 ? up.bone : up.parentBone;
+			flat.boneDepth = up.boneDepth;
+		}
+		auto boneInfo = m_BoneInfoMap.find(node.name);
+		if (boneInfo != m_BoneInfoMap.end())
+		{
+			flat.bone = boneInfo->second.id;
+			flat.offset = boneInfo->second.offset;
+			flat.boneDepth++;
+			if (flat.bone < bone_size)
+				m_BoneDepths[flat.bone] = flat.boneDepth;
+		}
+
+		int index = (int)m_Hierarchy.size();
+		m_Hierarchy.push_back(flat);
+		for (auto& child : node.children)
+			ReadFlatHierarchy(child, index);
+	}
+
 	void ReadHierarchyData(AssimpNodeData& dest, const aiNode* src)
 	{
 		assert(src);
@@ -119,11 +695,33 @@ private:
 			dest.children.push_back(newData);
 		}
 	}
+	std::string m_Name;
 	float m_Duration;
 	int m_TicksPerSecond;
 	std::map<std::string, Bone> m_Bones;
+	std::vector<CompressedBone> m_CompressedBones;
+	ResampledAnimation m_Resampled;
+	/*the bones of the node tree, with the nodes between them folded in (see HierarchyCompose::Bake)*/
+	std::vector<HierarchyNode> m_Hierarchy;
+	/*per bone id, the HierarchyNode::boneDepth of its node*/
+	std::vector<int> m_BoneDepths;
+	/*scratch for ComposePose: every node's global transform*/
+	std::vector<glm::mat4> m_Globals;
 	AssimpNodeData m_RootNode;
 	std::unordered_map<std::string, BoneInfo> m_BoneInfoMap;
+	glm::mat4 m_GlobalInverseTransform;
+	SkeletalPose m_BindPose;
+	std::vector<int> m_StaticBones;
+	/*root motion (see EnableRootMotion): the bone it is taken from or -1, and the space it is measured in*/
+	int m_RootMotionBone = -1;
+	bool m_ExtractYaw = true;
+	RootMotionTrack m_RootMotion;
+	glm::mat4 m_RootSpace = glm::mat4(1.0f);
+	glm::mat4 m_RootSpaceInverse = glm::mat4(1.0f);
+	glm::quat m_RootSpaceRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	AnimationEventTrack m_Events;
+	/*keys hold deltas against a reference pose (see MakeAdditive)*/
+	bool m_Additive = false;
 
 	int bone_size;
 };
\ No newline at end of file
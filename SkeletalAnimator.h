@@ -2,10 +2,31 @@
 
 #include <glm/glm.hpp>
 #include <vector>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <memory>
 #include <assimp/scene.h>
 #include <assimp/Importer.hpp>
 #include "SkeletalAnimation.h"
+#include "AnimationPoseCache.h"
 #include "Bone.h"
+#include "BoneMask.h"
+
+/**
+ * @brief A clip played over an animator's own clip on the bones of its mask only. Additive clips (see
+ * SkeletalAnimation::MakeAdditive) add their deltas to the pose; others replace it, blended by weight.
+ */
+struct AnimationLayer
+{
+	SkeletalAnimation* clip;
+	BoneMask mask;
+	/*scales the mask's weights; 0 turns the layer off*/
+	float weight = 1.0f;
+	bool repeat = true;
+	/*in ticks of the layer's clip*/
+	float time = 0.0f;
+};
 
 class SkeletalAnimator
 {
@@ -25,25 +46,85 @@ public:
 		for (int i = 0; i < size; i++)
 			m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
 
-		m_GlobalInverseTransform = inverse(m_CurrentAnimation->GetRootNode().transformation);
-
 	}
 
-	void UpdateAnimation(float dt)
+	/**
+	 * @brief Advances the clip by dt seconds and recomputes the palette, unless the clip, the bone budget
+	 * and the time (within getMinTimeStep()) are those of the last computed palette.
+	 * @param maxBoneDepth bones deeper than this are neither sampled nor composed, and follow their
+	 * nearest remaining ancestor (see SkeletalAnimation::ComposePose). Palettes from a pose cache are
+	 * shared by other instances and always complete. Animators with active layers compute their own.
+	 */
+	void UpdateAnimation(float dt, int maxBoneDepth = INT_MAX)
 	{
 		//m_DeltaTime = dt;
 		if (m_CurrentAnimation)
 		{
+			float previousTime = m_CurrentTime;
 			m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
+			bool wrapped = repeat && m_CurrentTime >= m_CurrentAnimation->GetDuration();
 			if (repeat) {
 				m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
 			}
+			m_RootMotion = m_CurrentAnimation->GetRootMotion(previousTime,
+				std::min(m_CurrentTime, m_CurrentAnimation->GetDuration()), wrapped);
+			if (m_EventQueue) {
+				m_CurrentAnimation->GetEvents().Collect(previousTime, m_CurrentTime, wrapped, [this](const AnimationEvent& event) {
+					m_EventQueue->push(event, m_EventSource);
+				});
+			}
+			bool layered = AdvanceLayers(dt);
 			if (m_CurrentTime < m_CurrentAnimation->GetDuration()) {
-				CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+				bool changed = m_CurrentAnimation != m_ComputedAnimation || maxBoneDepth != m_ComputedBoneDepth || layered
+					|| std::abs(m_CurrentTime - m_ComputedTime) >= m_MinTimeStep * m_CurrentAnimation->GetTicksPerSecond();
+				if (m_PoseCache && !layered) {
+					// Looked up even when unchanged: the cache evicts entries that go a frame without a request.
+					auto shared = m_PoseCache->get(m_CurrentAnimation, changed ? m_CurrentTime : m_ComputedTime);
+					changed = changed || shared != m_Shared;
+					m_Shared = std::move(shared);
+				}
+				else if (changed) {
+					m_Shared = nullptr;
+					// Each animator brings its own scratch, so animators sharing a clip can update on different threads.
+					m_CurrentAnimation->SamplePose(m_CurrentTime, m_Pose, m_Workspace, maxBoneDepth);
+					ApplyLayers();
+					m_CurrentAnimation->ComposePose(m_Pose, m_FinalBoneMatrices, m_Workspace, maxBoneDepth);
+				}
+				if (changed) {
+					m_ComputedAnimation = m_CurrentAnimation;
+					m_ComputedTime = m_CurrentTime;
+					m_ComputedBoneDepth = maxBoneDepth;
+					m_PaletteVersion++;
+				}
 			}
 		}
 	}
 
+	/**
+	 * @brief Plays clip over the animator's own clip on the bones of mask, e.g. an upper-body wave over a
+	 * run cycle (see SkeletalAnimation::GetBranchMask). Layers apply in the order they were added, and
+	 * sample only their masked bones.
+	 * @return the layer's index, for getLayer().
+	 */
+	int addLayer(SkeletalAnimation* clip, const BoneMask& mask, float weight = 1.0f)
+	{
+		AnimationLayer layer;
+		layer.clip = clip;
+		layer.mask = mask;
+		layer.weight = weight;
+		m_Layers.push_back(layer);
+		return (int)m_Layers.size() - 1;
+	}
+
+	AnimationLayer& getLayer(int index) {
+		return m_Layers[index];
+	}
+
+	void clearLayers() {
+		m_Layers.clear();
+		m_ComputedAnimation = nullptr;
+	}
+
 	void setRepeat(bool val) {
 		repeat = val;
 	}
@@ -52,37 +133,62 @@ public:
 	{
 		m_CurrentAnimation = pAnimation;
 		m_CurrentTime = 0.0f;
+		m_RootMotion = RootMotion();
+		m_ComputedAnimation = nullptr;
 	}
 
-	void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
+	/**
+	 * @brief The palette of the last update, without copying it. With a pose cache it is shared with
+	 * other animators; either way it is valid until the next update.
+	 */
+	const std::vector<glm::mat4>& GetFinalBoneMatrices() const
 	{
-		std::string nodeName = node->name;
-		glm::mat4 nodeTransform = node->transformation;
+		return m_Shared ? m_Shared->palette : m_FinalBoneMatrices;
+	}
 
-		Bone* Bone = m_CurrentAnimation->FindBone(nodeName);
+	/**
+	 * @brief Changes whenever the palette does, so renderers and skinning passes can skip re-uploading
+	 * or re-skinning a palette they already have.
+	 */
+	uint64_t GetPaletteVersion() const
+	{
+		return m_PaletteVersion;
+	}
 
-		if (Bone)
-		{
-			Bone->Update(m_CurrentTime);
-			nodeTransform = Bone->GetLocalTransform();
-		}
+	/*the clip's root motion over the last update (see SkeletalAnimation::EnableRootMotion)*/
+	const RootMotion& GetRootMotion() const
+	{
+		return m_RootMotion;
+	}
 
-		glm::mat4 globalTransformation = parentTransform * nodeTransform;
+	/**
+	 * @brief Sends the events the clip crosses in each update to queue, tagged with source. Pass nullptr to stop.
+	 */
+	void setEventQueue(AnimationEventQueue* queue, int source = 0)
+	{
+		m_EventQueue = queue;
+		m_EventSource = source;
+	}
 
-		const auto& boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end())
-		{
-			int index = boneInfoMap.at(nodeName).id;
-			m_FinalBoneMatrices[index] = m_GlobalInverseTransform * globalTransformation * boneInfoMap.at(nodeName).offset;
-		}
+	/*seconds of animation under which an update reuses the last palette*/
+	float getMinTimeStep() const { return m_MinTimeStep; }
+	void setMinTimeStep(float seconds) { m_MinTimeStep = seconds; }
 
-		for (int i = 0; i < node->childrenCount; i++)
-			CalculateBoneTransform(&node->children[i], globalTransformation);
+	/*the TRS pose behind the last computed bone matrices*/
+	const SkeletalPose& GetPose() const
+	{
+		return m_Shared ? m_Shared->pose : m_Pose;
 	}
 
-	std::vector<glm::mat4> GetFinalBoneMatrices()
+	/**
+	 * @brief Takes palettes from a cache shared with other animators instead of computing them, so
+	 * instances playing the same clip in step compute it once per frame. Pass nullptr to stop.
+	 */
+	void setPoseCache(AnimationPoseCache* cache)
 	{
-		return m_FinalBoneMatrices;
+		m_PoseCache = cache;
+		m_Shared = nullptr;
+		m_ComputedAnimation = nullptr;
 	}
 
 	void resetAnimation() {
@@ -95,14 +201,67 @@ public:
 		return m_CurrentTime;
 	}
 
+	SkeletalAnimation* getCurrentAnimation() {
+		return m_CurrentAnimation;
+	}
+
+	bool usesPoseCache() const {
+		return m_PoseCache != nullptr;
+	}
+
 private:
+	/*advances every layer by dt seconds; true if any of them is on*/
+	bool AdvanceLayers(float dt)
+	{
+		bool layered = false;
+		for (AnimationLayer& layer : m_Layers) {
+			float duration = layer.clip->GetDuration();
+			layer.time += layer.clip->GetTicksPerSecond() * dt;
+			layer.time = layer.repeat ? fmod(layer.time, duration) : std::min(layer.time, std::nextafter(duration, 0.0f));
+			layered = layered || layer.weight > 0.0f;
+		}
+		return layered;
+	}
+
+	/*applies the layers to the freshly sampled m_Pose, one masked bone at a time*/
+	void ApplyLayers()
+	{
+		for (AnimationLayer& layer : m_Layers) {
+			if (layer.weight <= 0.0f)
+				continue;
+			bool additive = layer.clip->IsAdditive();
+			layer.clip->SampleMasked(layer.time, layer.mask, m_Workspace,
+				[&](int id, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+				if (id >= (int)m_Pose.size())
+					return;
+				float weight = layer.weight * layer.mask.GetWeight(id);
+				if (additive)
+					m_Pose.AddBone(id, translation, rotation, scale, weight);
+				else
+					m_Pose.BlendBone(id, translation, rotation, scale, std::min(weight, 1.0f));
+			});
+		}
+	}
+
 	std::vector<glm::mat4> m_FinalBoneMatrices;
+	SkeletalPose m_Pose;
+	PoseWorkspace m_Workspace;
+	AnimationPoseCache* m_PoseCache = nullptr;
+	/*the pose cache entry behind the current palette, if it came from one*/
+	std::shared_ptr<const AnimationPoseCache::Entry> m_Shared;
+	std::vector<AnimationLayer> m_Layers;
+	AnimationEventQueue* m_EventQueue = nullptr;
+	int m_EventSource = 0;
 	SkeletalAnimation* m_CurrentAnimation;
 	float m_CurrentTime;
+	RootMotion m_RootMotion;
+	// What the current palette was computed from.
+	SkeletalAnimation* m_ComputedAnimation = nullptr;
+	float m_ComputedTime = 0.0f;
+	int m_ComputedBoneDepth = INT_MAX;
+	float m_MinTimeStep = 1e-4f;
+	uint64_t m_PaletteVersion = 0;
 	//float m_DeltaTime = 0;
 
 	bool repeat;
-
-
-	glm::mat4 m_GlobalInverseTransform;
 };
\ No newline at end of file
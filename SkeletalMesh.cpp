@@ -1,8 +1,13 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <iostream>
 #include "SkeletalMesh.h"
+#include "CpuSkinning.h"
 #include <glad/glad.h>
 #include <GL/GL.h>
+#include <array>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 
 using std::vector;
 using sf::Color;
@@ -10,6 +15,59 @@ using sf::Vector2u;
 using glm::mat4;
 using glm::vec4;
 
+// The GPU copy of a SkeletalVertex with N influences; meshes whose vertices need at most four upload
+// the smaller format. Attributes 4 and 5 hold the first four influences, 12 and 13 the rest.
+template<int N>
+struct GpuSkeletalVertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::vec2 TexCoords;
+	glm::vec3 Tangent;
+	int32_t BoneIDs[N];
+	float Weights[N];
+};
+
+template<int N>
+static size_t uploadVertices(const std::vector<SkeletalVertex>& vertices) {
+	using Vertex = GpuSkeletalVertex<N>;
+	std::vector<Vertex> gpu(vertices.size());
+	for (size_t v = 0; v < vertices.size(); v++) {
+		gpu[v].Position = vertices[v].Position;
+		gpu[v].Normal = vertices[v].Normal;
+		gpu[v].TexCoords = vertices[v].TexCoords;
+		gpu[v].Tangent = vertices[v].Tangent;
+		std::copy(vertices[v].m_BoneIDs, vertices[v].m_BoneIDs + N, gpu[v].BoneIDs);
+		std::copy(vertices[v].m_Weights, vertices[v].m_Weights + N, gpu[v].Weights);
+	}
+	glBufferData(GL_ARRAY_BUFFER, gpu.size() * sizeof(Vertex), gpu.data(), GL_STATIC_DRAW);
+
+	// Atrribute 0 is position: 3 contiguous floats (x/y/z)...
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Position));
+	glEnableVertexAttribArray(0);
+
+	// Attribute 1 is normal (nx, ny, nz): 3 contiguous floats, starting 12 bytes after the beginning of the vertex.
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+	glEnableVertexAttribArray(1);
+
+	// Attribute 2 is texture coordinates (u, v): 2 contiguous floats, starting 24 bytes after the beginning of the vertex.
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	glEnableVertexAttribArray(2);
+
+	// add: tangent vector
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+	glEnableVertexAttribArray(3);
+
+	// bones id and weights, four per attribute
+	for (int first = 0; first < N; first += 4) {
+		GLuint ids = first == 0 ? 4 : 12;
+		glVertexAttribIPointer(ids, 4, GL_INT, sizeof(Vertex), (void*)(offsetof(Vertex, BoneIDs) + first * sizeof(int32_t)));
+		glEnableVertexAttribArray(ids);
+		glVertexAttribPointer(ids + 1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, Weights) + first * sizeof(float)));
+		glEnableVertexAttribArray(ids + 1);
+	}
+	return sizeof(Vertex);
+}
+
 SkeletalMesh::SkeletalMesh(std::vector<SkeletalVertex>&& vertices, std::vector<uint32_t>&& faces,
 	Texture texture)
 	: SkeletalMesh(std::move(vertices), std::move(faces), std::vector<Texture>{texture}) {
@@ -18,64 +76,199 @@ SkeletalMesh::SkeletalMesh(std::vector<SkeletalVertex>&& vertices, std::vector<u
 SkeletalMesh::SkeletalMesh(std::vector<SkeletalVertex>&& vertices, std::vector<uint32_t>&& faces, std::vector<Texture>&& textures)
 	: m_vertexCount(vertices.size()), m_faceCount(faces.size()), m_textures(textures) {
 
+	// The GPU copy refers to bones by their index in m_bones.
+	std::vector<SkeletalVertex> local = vertices;
+	std::unordered_map<int32_t, int32_t> localIds;
+	for (auto& vertex : local) {
+		for (int i = 0; i < MAX_BONE_PER_VERTEX; i++) {
+			if (vertex.m_BoneIDs[i] < 0) {
+				break;
+			}
+			if (i >= 4) {
+				m_influences = 8;
+			}
+			auto found = localIds.insert({ vertex.m_BoneIDs[i], (int32_t)m_bones.size() });
+			if (found.second) {
+				m_bones.push_back(vertex.m_BoneIDs[i]);
+			}
+			vertex.m_BoneIDs[i] = found.first->second;
+		}
+	}
+	if (m_bones.size() > MAX_MESH_PALETTE) {
+		std::cerr << "SkeletalMesh: " << m_bones.size() << " bones exceed MAX_MESH_PALETTE; use splitByPalette\n";
+	}
+
 	// Generate a vertex array object on the GPU.
 	glGenVertexArrays(1, &m_vao);
 	// "Bind" the newly-generated vao, which makes future functions operate on that specific object.
 	glBindVertexArray(m_vao);
 
 	// Generate a vertex buffer object on the GPU.
-	uint32_t vbo;
-	glGenBuffers(1, &vbo);
+	glGenBuffers(1, &m_vbo);
 
 	// "Bind" the newly-generated vbo, which makes future functions operate on that specific object.
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
 	// This vbo is now associated with m_vao.
-	// Copy the contents of the vertices list to the buffer that lives on the GPU.
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(SkeletalVertex), &vertices[0], GL_STATIC_DRAW);
+	// Copy the contents of the vertices list to the buffer that lives on the GPU, in the smallest format
+	// that holds every influence, and inform OpenGL how to interpret it.
+	m_vertexStride = m_influences > 4 ? uploadVertices<8>(local) : uploadVertices<4>(local);
 
-	// Inform OpenGL how to interpret the buffer. Each vertex now has TWO attributes; a position and a color.
-	// Atrribute 0 is position: 3 contiguous floats (x/y/z)...
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkeletalVertex), 0);
-	glEnableVertexAttribArray(0);
+	// Generate a second buffer, to store the indices of each triangle in the mesh.
+	glGenBuffers(1, &m_ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * sizeof(uint32_t), &faces[0], GL_STATIC_DRAW);
 
-	// Attribute 1 is normal (nx, ny, nz): 3 contiguous floats, starting 12 bytes after the beginning of the vertex.
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkeletalVertex), (void*)offsetof(SkeletalVertex, Normal));
-	glEnableVertexAttribArray(1);
+	// Unbind the vertex array, so no one else can accidentally mess with it.
+	glBindVertexArray(0);
 
-	// Attribute 2 is texture coordinates (u, v): 2 contiguous floats, starting 24 bytes after the beginning of the vertex.
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SkeletalVertex), (void*)offsetof(SkeletalVertex, TexCoords));
-	glEnableVertexAttribArray(2);
+	// Keep the source data for CPU skinning and CPU-side queries.
+	m_vertices = std::make_shared<const std::vector<SkeletalVertex>>(std::move(vertices));
+	m_faces = std::make_shared<const std::vector<uint32_t>>(std::move(faces));
+}
 
-	// add: tangent vector
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(SkeletalVertex), (void*)offsetof(SkeletalVertex, Tangent));
+std::vector<SkeletalMesh> SkeletalMesh::splitByPalette(std::vector<SkeletalVertex>&& vertices, std::vector<uint32_t>&& faces,
+	std::vector<Texture>&& textures, size_t maxBones) {
+	std::vector<SkeletalMesh> meshes;
+	std::unordered_set<int32_t> all;
+	for (auto& vertex : vertices) {
+		for (int32_t bone : vertex.m_BoneIDs) {
+			if (bone >= 0) {
+				all.insert(bone);
+			}
+		}
+	}
+	if (all.size() <= maxBones) {
+		meshes.emplace_back(std::move(vertices), std::move(faces), std::move(textures));
+		return meshes;
+	}
+
+	std::vector<uint32_t> partFaces;
+	std::unordered_set<int32_t> partBones;
+	auto flush = [&]() {
+		std::unordered_map<uint32_t, uint32_t> remap;
+		std::vector<SkeletalVertex> partVertices;
+		for (auto& index : partFaces) {
+			auto found = remap.insert({ index, (uint32_t)partVertices.size() });
+			if (found.second) {
+				partVertices.push_back(vertices[index]);
+			}
+			index = found.first->second;
+		}
+		meshes.emplace_back(std::move(partVertices), std::move(partFaces), std::vector<Texture>(textures));
+		partFaces.clear();
+		partBones.clear();
+	};
+
+	for (size_t face = 0; face + 2 < faces.size(); face += 3) {
+		// The distinct bones of the triangle, at most 3 * MAX_BONE_PER_VERTEX.
+		int32_t bones[3 * MAX_BONE_PER_VERTEX];
+		size_t boneCount = 0;
+		for (size_t corner = 0; corner < 3; corner++) {
+			for (int32_t bone : vertices[faces[face + corner]].m_BoneIDs) {
+				if (bone >= 0 && std::find(bones, bones + boneCount, bone) == bones + boneCount) {
+					bones[boneCount++] = bone;
+				}
+			}
+		}
+		size_t added = std::count_if(bones, bones + boneCount, [&](int32_t bone) { return !partBones.count(bone); });
+		if (partBones.size() + added > maxBones && !partFaces.empty()) {
+			flush();
+		}
+		partBones.insert(bones, bones + boneCount);
+		partFaces.insert(partFaces.end(), faces.begin() + face, faces.begin() + face + 3);
+	}
+	if (!partFaces.empty()) {
+		flush();
+	}
+	std::cout << "SkeletalMesh: " << all.size() << " bones, split into " << meshes.size() << " meshes\n";
+	return meshes;
+}
+
+void SkeletalMesh::addTexture(Texture texture)
+{
+	m_textures.push_back(texture);
+}
+
+void SkeletalMesh::uploadPalette(ShaderProgram& program, const std::vector<glm::mat4>& palette) const
+{
+	std::array<glm::mat4, MAX_MESH_PALETTE> local;
+	size_t count = std::min(m_bones.size(), local.size());
+	for (size_t i = 0; i < count; i++) {
+		local[i] = m_bones[i] < (int32_t)palette.size() ? palette[m_bones[i]] : glm::mat4(1.0f);
+	}
+	if (count > 0) {
+		program.setUniform("finalBonesMatrices", local.data(), count);
+	}
+	program.setUniform("boneInfluences", m_influences);
+}
+
+void SkeletalMesh::enablePreSkinning()
+{
+	if (m_skinnedVao != 0) {
+		return;
+	}
+
+	// The skinned buffer is rewritten every frame by transform feedback.
+	glGenBuffers(1, &m_skinnedVbo);
+	glBindBuffer(GL_ARRAY_BUFFER, m_skinnedVbo);
+	glBufferData(GL_ARRAY_BUFFER, m_vertexCount * sizeof(SkinnedVertex), nullptr, GL_DYNAMIC_COPY);
+
+	// The static vertex array takes position, normal and tangent from the skinned buffer, and
+	// texture coordinates from the original vertices. Bone ids and weights are left disabled.
+	glGenVertexArrays(1, &m_skinnedVao);
+	glBindVertexArray(m_skinnedVao);
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Position));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Normal));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, Tangent));
 	glEnableVertexAttribArray(3);
 
-	// bones id
-	glVertexAttribIPointer(4, 4, GL_INT, sizeof(SkeletalVertex), (void*)offsetof(SkeletalVertex, m_BoneIDs));
-	glEnableVertexAttribArray(4);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, m_vertexStride, (void*)offsetof(GpuSkeletalVertex<4>, TexCoords));
+	glEnableVertexAttribArray(2);
 
-	// weights
-	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(SkeletalVertex), (void*)offsetof(SkeletalVertex, m_Weights));
-	glEnableVertexAttribArray(5);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
 
-	// Generate a second buffer, to store the indices of each triangle in the mesh.
-	uint32_t ebo;
-	glGenBuffers(1, &ebo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * sizeof(uint32_t), &faces[0], GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-	// Unbind the vertex array, so no one else can accidentally mess with it.
+void SkeletalMesh::preSkin(ShaderProgram& program, const std::vector<glm::mat4>& palette) const
+{
+	if (m_skinnedVao == 0) {
+		return;
+	}
+	uploadPalette(program, palette);
+
+	// Each vertex is drawn once as a point; the vertex shader's outputs are streamed into the skinned buffer.
+	glBindVertexArray(m_vao);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_skinnedVbo);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, m_vertexCount);
+	glEndTransformFeedback();
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
 	glBindVertexArray(0);
 }
 
-void SkeletalMesh::addTexture(Texture texture)
+void SkeletalMesh::cpuSkin(const std::vector<glm::mat4>& palette, unsigned maxThreads)
 {
-	m_textures.push_back(texture);
+	CpuSkinning::Skin(*m_vertices, m_cpuSkinned, palette, maxThreads);
+	uploadSkinned(m_cpuSkinned);
 }
 
-void SkeletalMesh::render(sf::RenderWindow& window, ShaderProgram& program) const {
-	// Activate the mesh's vertex array.
-	glBindVertexArray(m_vao);
+void SkeletalMesh::uploadSkinned(const std::vector<SkinnedVertex>& skinned) const
+{
+	if (m_skinnedVbo == 0 || skinned.size() != m_vertexCount) {
+		return;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, m_skinnedVbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, skinned.size() * sizeof(SkinnedVertex), skinned.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SkeletalMesh::bindTextures(ShaderProgram& program) const {
 	program.setUniform("hasNormalMap", false);
 	program.setUniform("hasSpecularMap", false);
 
@@ -92,6 +285,12 @@ void SkeletalMesh::render(sf::RenderWindow& window, ShaderProgram& program) cons
 		glActiveTexture(GL_TEXTURE0 + i);
 		glBindTexture(GL_TEXTURE_2D, m_textures[i].textureId);
 	}
+}
+
+void SkeletalMesh::render(sf::RenderWindow& window, ShaderProgram& program) const {
+	// Activate the mesh's vertex array; a pre-skinned mesh draws its captured vertices instead.
+	glBindVertexArray(m_skinnedVao != 0 ? m_skinnedVao : m_vao);
+	bindTextures(program);
 	//std::cout << m_faceCount;
 	//std::cout << "\n";
 
@@ -102,6 +301,54 @@ void SkeletalMesh::render(sf::RenderWindow& window, ShaderProgram& program) cons
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void SkeletalMesh::render(sf::RenderWindow& window, ShaderProgram& program, const std::vector<glm::mat4>& palette) const {
+	uploadPalette(program, palette);
+	render(window, program);
+}
+
+void SkeletalMesh::enableInstancing(uint32_t instanceBuffer) {
+	if (m_instanceVbo == instanceBuffer) {
+		return;
+	}
+	m_instanceVbo = instanceBuffer;
+
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+	// A mat4 attribute takes four consecutive locations, one per column.
+	for (int column = 0; column < 4; column++) {
+		glVertexAttribPointer(6 + column, 4, GL_FLOAT, GL_FALSE, sizeof(SkeletalInstance),
+			(void*)(offsetof(SkeletalInstance, Model) + column * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(6 + column);
+		glVertexAttribDivisor(6 + column, 1);
+	}
+	// Time offset and scale, read together as a vec2.
+	glVertexAttribPointer(10, 2, GL_FLOAT, GL_FALSE, sizeof(SkeletalInstance), (void*)offsetof(SkeletalInstance, TimeOffset));
+	glEnableVertexAttribArray(10);
+	glVertexAttribDivisor(10, 1);
+	glVertexAttribIPointer(11, 1, GL_INT, sizeof(SkeletalInstance), (void*)offsetof(SkeletalInstance, Palette));
+	glEnableVertexAttribArray(11);
+	glVertexAttribDivisor(11, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void SkeletalMesh::renderInstanced(sf::RenderWindow& window, ShaderProgram& program, size_t instanceCount) const {
+	if (m_instanceVbo == 0 || instanceCount == 0) {
+		return;
+	}
+	// Always the original vertex array: instances are skinned by the program, never pre-skinned.
+	glBindVertexArray(m_vao);
+	bindTextures(program);
+	if (!m_bones.empty()) {
+		program.setUniform("meshBones", m_bones.data(), std::min(m_bones.size(), (size_t)MAX_MESH_PALETTE));
+	}
+	program.setUniform("boneInfluences", m_influences);
+	glDrawElementsInstanced(GL_TRIANGLES, m_faceCount, GL_UNSIGNED_INT, nullptr, instanceCount);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 SkeletalMesh SkeletalMesh::square(const std::vector<Texture>& textures) {
 
 	std::vector<SkeletalVertex> vertices;
@@ -1,11 +1,18 @@
 #pragma once
+#include <memory>
 #include <SFML/Graphics.hpp>
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 #include "ShaderProgram.h"
 #include "Texture.h"
 
-constexpr int MAX_BONE_PER_VERTEX = 4;
+// The most bone influences a vertex can keep. Slots are sorted by weight, unused ones trailing with id -1;
+// on the GPU a mesh uses 4 or 8 of them, whichever its vertices need (see getInfluences).
+constexpr int MAX_BONE_PER_VERTEX = 8;
+// The most bones one mesh may reference; larger meshes are split at import (see splitByPalette).
+// Must match MAX_BONES in skeletal.vert, shadow_map.vert and skinning.vert, and the meshBones arrays
+// of the crowd shaders.
+constexpr int MAX_MESH_PALETTE = 64;
 
 
 struct SkeletalVertex {
@@ -25,6 +32,26 @@ struct SkeletalVertex {
 
 };
 
+// A vertex after skinning, as captured by the pre-skinning pass (shaders/skinning.vert).
+struct SkinnedVertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::vec3 Tangent;
+};
+
+// Per-instance attributes of an instanced draw (see SkeletalMesh::enableInstancing), read by
+// shaders/crowd.vert and shaders/crowd_skinned.vert.
+struct SkeletalInstance {
+	// placed before the object's own hierarchy transforms
+	glm::mat4 Model;
+	// seconds added to the shared clock, so instances play out of step
+	float TimeOffset;
+	// playback speed
+	float TimeScale;
+	// slot of the instance's bone palette in a SkinnedCrowd
+	int32_t Palette;
+};
+
 /**
  * @brief Represents a mesh whose vertices have positions, normal vectors, and texture coordinates;
  * as well as a list of Textures to bind when rendering the mesh.
@@ -32,10 +59,35 @@ struct SkeletalVertex {
 class SkeletalMesh {
 private:
 	uint32_t m_vao;
+	uint32_t m_vbo;
+	uint32_t m_ebo;
 	std::vector<Texture> m_textures;
 	size_t m_vertexCount;
 	size_t m_faceCount;
 
+	// Pre-skinning: a buffer of SkinnedVertex written once per frame, and a vertex array that
+	// reads it as a static mesh. Both are 0 until enablePreSkinning() is called.
+	uint32_t m_skinnedVao = 0;
+	uint32_t m_skinnedVbo = 0;
+
+	// The buffer enableInstancing() bound the per-instance attributes to, or 0.
+	uint32_t m_instanceVbo = 0;
+
+	// The model bone ids this mesh references. The GPU vertex buffer holds indices into this list, so
+	// a draw uploads only these matrices; the CPU copy of the vertices keeps the model bone ids.
+	std::vector<int32_t> m_bones;
+	// Influences per vertex in the GPU buffer, 4 or 8, and that buffer's vertex size.
+	int32_t m_influences = 4;
+	size_t m_vertexStride = 0;
+
+	// CPU copies of the source data, shared between copies of the mesh, for CPU skinning and queries.
+	std::shared_ptr<const std::vector<SkeletalVertex>> m_vertices;
+	std::shared_ptr<const std::vector<uint32_t>> m_faces;
+	// The result of the last cpuSkin() call, in mesh space.
+	std::vector<SkinnedVertex> m_cpuSkinned;
+
+	void bindTextures(ShaderProgram& program) const;
+
 public:
 	SkeletalMesh() = delete;
 
@@ -49,14 +101,73 @@ public:
 	SkeletalMesh(std::vector<SkeletalVertex>&& vertices, std::vector<uint32_t>&& faces,
 		std::vector<Texture>&& textures);
 
+	/**
+	 * @brief Builds one mesh, or several when the vertices reference more than maxBones bones: faces are
+	 * grouped in order until a group's palette would overflow, and each group becomes its own mesh.
+	 */
+	static std::vector<SkeletalMesh> splitByPalette(std::vector<SkeletalVertex>&& vertices, std::vector<uint32_t>&& faces,
+		std::vector<Texture>&& textures, size_t maxBones = MAX_MESH_PALETTE);
+
 	void addTexture(Texture texture);
 
+	/**
+	 * @brief Sets finalBonesMatrices to this mesh's local palette, gathered from the model's palette,
+	 * and boneInfluences to the mesh's vertex format.
+	 */
+	void uploadPalette(ShaderProgram& program, const std::vector<glm::mat4>& palette) const;
+
+	/**
+	 * @brief Allocates the pre-skinned vertex buffer. From then on, render() draws the skinned
+	 * vertices captured by the last preSkin() call, and the mesh must be rendered as static.
+	 */
+	void enablePreSkinning();
+
+	/**
+	 * @brief Skins every vertex into the pre-skinned buffer with the active transform-feedback program,
+	 * which must have GL_RASTERIZER_DISCARD enabled.
+	 */
+	void preSkin(ShaderProgram& program, const std::vector<glm::mat4>& palette) const;
+
+	/**
+	 * @brief Skins the mesh on the CPU with the given bone palette (see CpuSkinning.h). The result is kept
+	 * for getCpuSkinnedVertices(), and uploaded into the pre-skinned buffer if pre-skinning is enabled.
+	 */
+	void cpuSkin(const std::vector<glm::mat4>& palette, unsigned maxThreads = 0);
+
+	/**
+	 * @brief Replaces the contents of the pre-skinned buffer with vertices skinned elsewhere.
+	 */
+	void uploadSkinned(const std::vector<SkinnedVertex>& skinned) const;
+
+	const std::vector<SkeletalVertex>& getVertices() const { return *m_vertices; }
+	const std::vector<uint32_t>& getFaces() const { return *m_faces; }
+	const std::vector<SkinnedVertex>& getCpuSkinnedVertices() const { return m_cpuSkinned; }
+	const std::vector<int32_t>& getBones() const { return m_bones; }
+	int32_t getInfluences() const { return m_influences; }
+
 
 	/**
 	 * @brief Renders the mesh to the given context.
 	 */
 	void render(sf::RenderWindow& window, ShaderProgram& program) const;
 
+	/**
+	 * @brief Renders the mesh skinned with the model's bone palette (see uploadPalette).
+	 */
+	void render(sf::RenderWindow& window, ShaderProgram& program, const std::vector<glm::mat4>& palette) const;
+
+	/**
+	 * @brief Reads SkeletalInstance attributes 6-11 from the given buffer, one record per instance.
+	 * Ordinary draws are unaffected, since their shaders do not declare those attributes.
+	 */
+	void enableInstancing(uint32_t instanceBuffer);
+
+	/**
+	 * @brief Draws instanceCount copies of the unskinned mesh in one call; the program does the skinning,
+	 * mapping the mesh's bone indices to model bone ids with the meshBones uniform set here.
+	 */
+	void renderInstanced(sf::RenderWindow& window, ShaderProgram& program, size_t instanceCount) const;
+
 
 	static SkeletalMesh square(const std::vector<Texture>& textures);
 };
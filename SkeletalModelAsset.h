@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <SFML/Graphics.hpp>
+#include "Skeletal.h"
+#include "SkeletalAnimator.h"
+#include "ShaderProgram.h"
+
+/**
+ * @brief What every character of one model shares: the GPU meshes, the object hierarchy and the bone
+ * info map. It is imported and uploaded once and only read afterwards; the characters themselves are
+ * SkeletalModelInstances. The meshes are skinned on the GPU with each instance's palette, so pre-skinning
+ * and CPU skinning, which keep their result in the mesh, must stay disabled on them.
+ */
+class SkeletalModelAsset
+{
+public:
+	SkeletalModelAsset(const std::string& path, bool flipTextureCoords, int maxInfluences = 4)
+		: m_Model(path, flipTextureCoords, maxInfluences)
+	{
+	}
+
+	const SkeletalObject& getRoot() const { return m_Model.getRoot(); }
+	const std::unordered_map<std::string, BoneInfo>& getBoneInfoMap() const { return m_Model.GetBoneInfoMap(); }
+	int getBoneCount() const { return m_Model.GetBoneCount(); }
+
+	/*the model itself, for setup before any instance exists: loading clips for it, adding textures*/
+	Skeletal& getSkeletal() { return m_Model; }
+
+private:
+	Skeletal m_Model;
+};
+
+/**
+ * @brief One character drawn with a shared SkeletalModelAsset: a transform and an animator, nothing
+ * else. Spawning one imports and uploads nothing.
+ */
+class SkeletalModelInstance
+{
+public:
+	SkeletalModelInstance(std::shared_ptr<const SkeletalModelAsset> asset, SkeletalAnimation* clip,
+		const glm::mat4& transform = glm::mat4(1.0f))
+		: m_Asset(std::move(asset)), m_Animator(clip), m_Transform(transform)
+	{
+	}
+
+	void setTransform(const glm::mat4& transform) { m_Transform = transform; }
+	const glm::mat4& getTransform() const { return m_Transform; }
+	SkeletalAnimator& getAnimator() { return m_Animator; }
+	const SkeletalModelAsset& getAsset() const { return *m_Asset; }
+
+	void update(float dt)
+	{
+		m_Animator.UpdateAnimation(dt);
+	}
+
+	/**
+	 * @brief Renders the asset's hierarchy placed by the instance transform, skinned with the instance's palette.
+	 */
+	void render(sf::RenderWindow& window, ShaderProgram& program)
+	{
+		program.activate();
+		program.setUniform("skeletal", true);
+		m_Asset->getRoot().renderRecursive(window, program, m_Transform, m_Animator.GetFinalBoneMatrices());
+		program.setUniform("skeletal", false);
+	}
+
+private:
+	std::shared_ptr<const SkeletalModelAsset> m_Asset;
+	SkeletalAnimator m_Animator;
+	glm::mat4 m_Transform;
+};
@@ -2,19 +2,44 @@
 #include <glm/gtx/string_cast.hpp>
 #include <glm/ext.hpp>
 #include "SkeletalObject.h"
+#include "CpuSkinning.h"
 #include <iostream>
 
 
-void SkeletalObject::rebuildModelMatrix() {
-	auto m = glm::translate(glm::mat4(1), m_position);
+glm::mat4 SkeletalObject::buildModelMatrix(const glm::vec3& position, const glm::vec3& orientation) const {
+	auto m = glm::translate(glm::mat4(1), position);
 	m = glm::translate(m, m_center * m_scale);
-	m = glm::rotate(m, m_orientation[2], glm::vec3(0, 0, 1));
-	m = glm::rotate(m, m_orientation[0], glm::vec3(1, 0, 0));
-	m = glm::rotate(m, m_orientation[1], glm::vec3(0, 1, 0));
+	m = glm::rotate(m, orientation[2], glm::vec3(0, 0, 1));
+	m = glm::rotate(m, orientation[0], glm::vec3(1, 0, 0));
+	m = glm::rotate(m, orientation[1], glm::vec3(0, 1, 0));
 	m = glm::scale(m, m_scale);
 	m = glm::translate(m, -m_center);
-	m = m * m_baseTransform;
-	m_modelMatrix = m;
+	return m * m_baseTransform;
+}
+
+void SkeletalObject::rebuildModelMatrix() {
+	m_modelMatrix = buildModelMatrix(m_position, m_orientation);
+	// Until the next interpolateRender(), render the state as it is.
+	m_renderMatrix = m_modelMatrix;
+	m_renderPosition = m_position;
+}
+
+void SkeletalObject::storePreviousState() {
+	m_previousPosition = m_position;
+	m_previousOrientation = m_orientation;
+	m_hasPreviousState = true;
+}
+
+void SkeletalObject::interpolateRender(float alpha) {
+	if (!m_hasPreviousState) {
+		return;
+	}
+	m_renderPosition = glm::mix(m_previousPosition, m_position, alpha);
+	m_renderMatrix = buildModelMatrix(m_renderPosition, glm::mix(m_previousOrientation, m_orientation, alpha));
+}
+
+const glm::vec3& SkeletalObject::getRenderPosition() const {
+	return m_renderPosition;
 }
 
 SkeletalObject::SkeletalObject(std::vector<SkeletalMesh>&& meshes)
@@ -52,6 +77,13 @@ const std::string& SkeletalObject::getName() const {
 	return m_name;
 }
 
+/**
+ * @brief Gets the object's local->parent transformation, excluding its parents in the hierarchy.
+ */
+const glm::mat4& SkeletalObject::getModelMatrix() const {
+	return m_modelMatrix;
+}
+
 size_t SkeletalObject::numberOfChildren() const {
 	return m_children.size();
 }
@@ -122,7 +154,7 @@ void SkeletalObject::render(sf::RenderWindow& window, ShaderProgram& shaderProgr
  */
 void SkeletalObject::renderRecursive(sf::RenderWindow& window, ShaderProgram& shaderProgram, const glm::mat4& parentMatrix) const {
 	// This object's true model matrix is the combination of its parent's matrix and the object's matrix.
-	glm::mat4 trueModel = parentMatrix * m_modelMatrix;
+	glm::mat4 trueModel = parentMatrix * m_renderMatrix;
 	shaderProgram.setUniform("model", trueModel);
 	// Render each mesh in the object.
 	for (auto& mesh : m_meshes) {
@@ -134,6 +166,132 @@ void SkeletalObject::renderRecursive(sf::RenderWindow& window, ShaderProgram& sh
 	}
 }
 
+void SkeletalObject::render(sf::RenderWindow& window, ShaderProgram& shaderProgram, const std::vector<glm::mat4>& palette) const {
+	renderRecursive(window, shaderProgram, glm::mat4(1), palette);
+}
+
+void SkeletalObject::renderRecursive(sf::RenderWindow& window, ShaderProgram& shaderProgram, const glm::mat4& parentMatrix,
+	const std::vector<glm::mat4>& palette) const {
+	glm::mat4 trueModel = parentMatrix * m_renderMatrix;
+	shaderProgram.setUniform("model", trueModel);
+	for (auto& mesh : m_meshes) {
+		mesh.render(window, shaderProgram, palette);
+	}
+	for (auto& child : m_children) {
+		child.renderRecursive(window, shaderProgram, trueModel, palette);
+	}
+}
+
+void SkeletalObject::enablePreSkinning() {
+	for (auto& mesh : m_meshes) {
+		mesh.enablePreSkinning();
+	}
+	for (auto& child : m_children) {
+		child.enablePreSkinning();
+	}
+}
+
+/**
+ * @brief Skins the meshes of the object and its children into their pre-skinned buffers.
+ * Skinning happens in mesh space, so no model matrix is needed here.
+ */
+void SkeletalObject::preSkin(ShaderProgram& shaderProgram, const std::vector<glm::mat4>& palette) const {
+	for (auto& mesh : m_meshes) {
+		mesh.preSkin(shaderProgram, palette);
+	}
+	for (auto& child : m_children) {
+		child.preSkin(shaderProgram, palette);
+	}
+}
+
+/**
+ * @brief Visits every mesh in the hierarchy together with its world matrix, as renderRecursive() would draw it.
+ */
+template<class F>
+static void forEachMeshRecursive(const SkeletalObject& object, const glm::mat4& trueModel, F&& visit) {
+	for (auto& mesh : object.getMeshes()) {
+		visit(mesh, trueModel);
+	}
+	for (size_t i = 0; i < object.numberOfChildren(); i++) {
+		auto& child = object.getChild(i);
+		forEachMeshRecursive(child, trueModel * child.getModelMatrix(), visit);
+	}
+}
+
+void SkeletalObject::enableInstancing(uint32_t instanceBuffer) {
+	for (auto& mesh : m_meshes) {
+		mesh.enableInstancing(instanceBuffer);
+	}
+	for (auto& child : m_children) {
+		child.enableInstancing(instanceBuffer);
+	}
+}
+
+/**
+ * @brief Renders every mesh of the hierarchy once per instance; each instance's matrix is applied
+ * on top of the object's own transformation.
+ */
+void SkeletalObject::renderInstanced(sf::RenderWindow& window, ShaderProgram& shaderProgram, size_t instanceCount) const {
+	forEachMeshRecursive(*this, m_renderMatrix, [&](const SkeletalMesh& mesh, const glm::mat4& model) {
+		shaderProgram.setUniform("model", model);
+		mesh.renderInstanced(window, shaderProgram, instanceCount);
+	});
+}
+
+void SkeletalObject::cpuSkin(const std::vector<glm::mat4>& palette, unsigned maxThreads) {
+	for (auto& mesh : m_meshes) {
+		mesh.cpuSkin(palette, maxThreads);
+	}
+	for (auto& child : m_children) {
+		child.cpuSkin(palette, maxThreads);
+	}
+}
+
+/**
+ * @brief Computes the world-space bounds of the vertices from the last cpuSkin() call.
+ * @return false if nothing has been skinned on the CPU yet.
+ */
+bool SkeletalObject::skinnedBounds(glm::vec3& min, glm::vec3& max) const {
+	bool any = false;
+	forEachMeshRecursive(*this, m_modelMatrix, [&](const SkeletalMesh& mesh, const glm::mat4& model) {
+		if (mesh.getCpuSkinnedVertices().empty())
+			return;
+		glm::vec3 meshMin, meshMax;
+		CpuSkinning::ComputeBounds(mesh.getCpuSkinnedVertices(), meshMin, meshMax);
+		for (int corner = 0; corner < 8; corner++) {
+			glm::vec3 local(corner & 1 ? meshMax.x : meshMin.x, corner & 2 ? meshMax.y : meshMin.y, corner & 4 ? meshMax.z : meshMin.z);
+			glm::vec3 world = glm::vec3(model * glm::vec4(local, 1.0f));
+			min = any ? glm::min(min, world) : world;
+			max = any ? glm::max(max, world) : world;
+			any = true;
+		}
+	});
+	return any;
+}
+
+/**
+ * @brief Picks against the vertices from the last cpuSkin() call with a world-space ray.
+ * @param distance receives the ray parameter of the nearest hit, in units of direction.
+ */
+bool SkeletalObject::raycastSkinned(const glm::vec3& origin, const glm::vec3& direction, float& distance) const {
+	bool hit = false;
+	forEachMeshRecursive(*this, m_modelMatrix, [&](const SkeletalMesh& mesh, const glm::mat4& model) {
+		if (mesh.getCpuSkinnedVertices().empty())
+			return;
+		// The ray parameter is preserved by the affine change into mesh space.
+		glm::mat4 toMesh = glm::inverse(model);
+		glm::vec3 localOrigin = glm::vec3(toMesh * glm::vec4(origin, 1.0f));
+		glm::vec3 localDirection = glm::vec3(toMesh * glm::vec4(direction, 0.0f));
+		float t;
+		if (CpuSkinning::Raycast(mesh.getCpuSkinnedVertices(), mesh.getFaces(), localOrigin, localDirection, t)
+			&& (!hit || t < distance)) {
+			distance = t;
+			hit = true;
+		}
+	});
+	return hit;
+}
+
 
 void SkeletalObject::tick(float_t dt) {
 	glm::vec3 total_force(0, 0, 0);
@@ -144,6 +302,11 @@ void SkeletalObject::tick(float_t dt) {
 	velocity += acceleration * dt;
 	m_position += velocity * dt;
 
+	// The clip's model space is the object's, so its model matrix carries the step into the world.
+	m_position += glm::mat3(m_modelMatrix) * pending_root_motion.translation;
+	m_orientation.y += pending_root_motion.yaw;
+	pending_root_motion = RootMotion();
+
 	rotational_velocity += rotational_acceleration * dt;
 	m_orientation += rotational_velocity * dt;
 
@@ -3,6 +3,7 @@
 #include <vector>
 #include "SkeletalMesh.h"
 #include "ShaderProgram.h"
+#include "RootMotion.h"
 /**
  * @brief Represents an object placed in a 3D scene. The object is a node in an hierarchy of
  * objects representing a single 3D model. Each object in the hierarchy has its own position,
@@ -24,6 +25,13 @@ private:
 	glm::mat4 m_modelMatrix;
 	glm::mat4 m_baseTransform;
 
+	// Render interpolation: the state before the last simulation step, and the matrix rendering uses.
+	glm::vec3 m_previousPosition;
+	glm::vec3 m_previousOrientation;
+	bool m_hasPreviousState = false;
+	glm::mat4 m_renderMatrix;
+	glm::vec3 m_renderPosition;
+
 	// Some objects from Assimp imports have a "name" field, useful for debugging.
 	std::string m_name;
 
@@ -35,11 +43,14 @@ private:
 	//glm::vec3 acceleration;
 	glm::vec3 rotational_acceleration;
 	std::vector<glm::vec3> forces_list;
+	// Root motion handed over since the last tick, relative to the facing at that tick.
+	RootMotion pending_root_motion;
 	// Object mass
 	float_t mass;
 
 	// Recomputes the local->world transformation matrix.
 	void rebuildModelMatrix();
+	glm::mat4 buildModelMatrix(const glm::vec3& position, const glm::vec3& orientation) const;
 
 public:
 	// No default constructor; you must have a mesh to initialize an object.
@@ -54,6 +65,7 @@ public:
 	const glm::vec3& getScale() const;
 	const glm::vec3& getCenter() const;
 	const std::string& getName() const;
+	const glm::mat4& getModelMatrix() const;
 
 	// Child management.
 	size_t numberOfChildren() const;
@@ -76,15 +88,46 @@ public:
 	// Rendering.
 	void render(sf::RenderWindow& window, ShaderProgram& shaderProgram) const;
 	void renderRecursive(sf::RenderWindow& window, ShaderProgram& shaderProgram, const glm::mat4& parentMatrix) const;
+	// Skinned with the model's bone palette; each mesh uploads only the bones it references.
+	void render(sf::RenderWindow& window, ShaderProgram& shaderProgram, const std::vector<glm::mat4>& palette) const;
+	void renderRecursive(sf::RenderWindow& window, ShaderProgram& shaderProgram, const glm::mat4& parentMatrix,
+		const std::vector<glm::mat4>& palette) const;
+
+	// Pre-skinning: skin the meshes once per frame, then render them as static meshes in every pass.
+	void enablePreSkinning();
+	void preSkin(ShaderProgram& shaderProgram, const std::vector<glm::mat4>& palette) const;
+
+	// Instancing: draw many copies of the hierarchy in one call per mesh (see SkeletalMesh::enableInstancing).
+	void enableInstancing(uint32_t instanceBuffer);
+	void renderInstanced(sf::RenderWindow& window, ShaderProgram& shaderProgram, size_t instanceCount) const;
+
+	// CPU skinning, for machines without fast GPU skinning and for CPU-side queries of the skinned shape.
+	void cpuSkin(const std::vector<glm::mat4>& palette, unsigned maxThreads = 0);
+	bool skinnedBounds(glm::vec3& min, glm::vec3& max) const;
+	bool raycastSkinned(const glm::vec3& origin, const glm::vec3& direction, float& distance) const;
+	const std::vector<SkeletalMesh>& getMeshes() const { return m_meshes; }
 
 
 
 	// tick
 	void tick(float_t dt);
 
+	// Render interpolation for a fixed-step simulation (see FixedTimestep): call storePreviousState() before
+	// each step, and interpolateRender(alpha) once per frame after the steps; rendering then draws the object
+	// alpha of the way from the state before the last step to the state after it.
+	void storePreviousState();
+	void interpolateRender(float alpha);
+	const glm::vec3& getRenderPosition() const;
+
 	// add force
 	void addForce(const glm::vec3& force);
 
+	// Root motion: movement taken out of the animation (see SkeletalAnimation::EnableRootMotion),
+	// applied by the next tick() in the object's own frame, on top of its velocity.
+	void addRootMotion(const RootMotion& motion) {
+		pending_root_motion = pending_root_motion.Then(motion);
+	}
+
 	// Mass
 	void setMass(float_t nMass) {
 		mass = nMass;
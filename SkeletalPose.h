@@ -0,0 +1,155 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/quaternion.hpp>
+#include "RootMotion.h"
+
+/**
+ * @brief A pose of a skeleton in TRS space: the local translation, rotation and scale of every bone,
+ * stored as separate arrays indexed by bone id (the same index as the final bone matrices).
+ * Sampling, blending and additive layering all work on poses; matrices are only built once, when
+ * SkeletalAnimation::ComposePose turns a pose into the final bone matrices.
+ */
+struct SkeletalPose
+{
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+	/*the root motion of the step that produced a weighted sum, from clips that extract it (see SkeletalAnimation::EnableRootMotion)*/
+	RootMotion rootMotion;
+	/*per bone, the weight summed into it so far; only meaningful between ClearWeighted and NormalizeWeighted*/
+	std::vector<float> weights;
+
+	size_t size() const { return translations.size(); }
+
+	/*resizes to boneCount bones; new bones get the identity transform*/
+	void resize(size_t boneCount)
+	{
+		translations.resize(boneCount, glm::vec3(0.0f));
+		rotations.resize(boneCount, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		scales.resize(boneCount, glm::vec3(1.0f));
+	}
+
+	glm::mat4 LocalTransform(int bone) const
+	{
+		return glm::translate(glm::mat4(1.0f), translations[bone])
+			* glm::toMat4(rotations[bone])
+			* glm::scale(glm::mat4(1.0f), scales[bone]);
+	}
+
+	/*zeroes boneCount bones, ready to sum weighted contributions with AccumulateBone*/
+	void ClearWeighted(size_t boneCount)
+	{
+		translations.assign(boneCount, glm::vec3(0.0f));
+		rotations.assign(boneCount, glm::quat(0.0f, 0.0f, 0.0f, 0.0f));
+		scales.assign(boneCount, glm::vec3(0.0f));
+		weights.assign(boneCount, 0.0f);
+		rootMotion = RootMotion();
+	}
+
+	/**
+	 * @brief Adds one weighted bone transform. Rotations are flipped into the hemisphere of what has
+	 * been summed so far, so any number of contributions blend without slerp chains.
+	 */
+	void AccumulateBone(int bone, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale, float weight)
+	{
+		translations[bone] += translation * weight;
+		rotations[bone] += (glm::dot(rotations[bone], rotation) < 0.0f ? -weight : weight) * rotation;
+		scales[bone] += scale * weight;
+		weights[bone] += weight;
+	}
+
+	/**
+	 * @brief Finishes a weighted sum, dividing each bone by the weight it actually received: clips with
+	 * fewer bones than the accumulator leave the rest only partly covered. Bones nothing was summed into
+	 * take their transform from fallback (e.g. a bind pose) where it has them, else the identity.
+	 */
+	void NormalizeWeighted(const SkeletalPose* fallback = nullptr)
+	{
+		for (size_t i = 0; i < size(); i++)
+		{
+			if (weights[i] <= 0.0f)
+			{
+				bool known = fallback && i < fallback->size();
+				translations[i] = known ? fallback->translations[i] : glm::vec3(0.0f);
+				rotations[i] = known ? fallback->rotations[i] : glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+				scales[i] = known ? fallback->scales[i] : glm::vec3(1.0f);
+				continue;
+			}
+			float inverse = 1.0f / weights[i];
+			translations[i] *= inverse;
+			scales[i] *= inverse;
+			float length = glm::length(rotations[i]);
+			rotations[i] = length > 0.0f ? rotations[i] / length : glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+		}
+	}
+
+	/*blends one bone toward the given transform by t, as Blend does for whole poses*/
+	void BlendBone(int bone, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale, float t)
+	{
+		translations[bone] = glm::mix(translations[bone], translation, t);
+		rotations[bone] = glm::slerp(rotations[bone], rotation, t);
+		scales[bone] = glm::mix(scales[bone], scale, t);
+	}
+
+	/*applies weight of one bone's additive delta, as ApplyAdditive does for whole poses*/
+	void AddBone(int bone, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale, float weight)
+	{
+		translations[bone] += translation * weight;
+		rotations[bone] = glm::normalize(rotations[bone] * glm::slerp(glm::quat(1.0f, 0.0f, 0.0f, 0.0f), rotation, weight));
+		scales[bone] *= glm::mix(glm::vec3(1.0f), scale, weight);
+	}
+
+	/**
+	 * @brief out = a blended toward b by t; lerp for translation and scale, slerp for rotation.
+	 * Bones missing from b keep a's transform. out may alias a.
+	 */
+	static void Blend(const SkeletalPose& a, const SkeletalPose& b, float t, SkeletalPose& out)
+	{
+		size_t count = std::min(a.size(), b.size());
+		if (&out != &a)
+			out = a;
+		for (size_t i = 0; i < count; i++)
+		{
+			out.translations[i] = glm::mix(a.translations[i], b.translations[i], t);
+			out.rotations[i] = glm::slerp(a.rotations[i], b.rotations[i], t);
+			out.scales[i] = glm::mix(a.scales[i], b.scales[i], t);
+		}
+	}
+
+	/**
+	 * @brief Computes the additive delta that turns reference into pose, for use with ApplyAdditive.
+	 */
+	static void MakeAdditive(const SkeletalPose& pose, const SkeletalPose& reference, SkeletalPose& out)
+	{
+		size_t count = std::min(pose.size(), reference.size());
+		out.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			out.translations[i] = pose.translations[i] - reference.translations[i];
+			out.rotations[i] = glm::normalize(glm::inverse(reference.rotations[i]) * pose.rotations[i]);
+			out.scales[i] = pose.scales[i] / reference.scales[i];
+		}
+	}
+
+	/**
+	 * @brief out = base with weight of the additive delta applied on top, in each bone's local space.
+	 * out may alias base.
+	 */
+	static void ApplyAdditive(const SkeletalPose& base, const SkeletalPose& additive, float weight, SkeletalPose& out)
+	{
+		size_t count = std::min(base.size(), additive.size());
+		if (&out != &base)
+			out = base;
+		const glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+		for (size_t i = 0; i < count; i++)
+		{
+			out.translations[i] = base.translations[i] + additive.translations[i] * weight;
+			out.rotations[i] = glm::normalize(base.rotations[i] * glm::slerp(identity, additive.rotations[i], weight));
+			out.scales[i] = base.scales[i] * glm::mix(glm::vec3(1.0f), additive.scales[i], weight);
+		}
+	}
+};
@@ -0,0 +1,84 @@
+#include "SkinnedCrowd.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <atomic>
+#include <glad/glad.h>
+
+SkinnedCrowd::SkinnedCrowd(SkeletalObject& object, int boneCount)
+	: m_object(object), m_boneCount(boneCount) {
+	glGenBuffers(1, &m_instanceVbo);
+	m_object.enableInstancing(m_instanceVbo);
+
+	// The texture buffer views the palette buffer as RGBA32F texels, one matrix column each.
+	glGenBuffers(1, &m_paletteBuffer);
+	glGenTextures(1, &m_paletteTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, m_paletteTexture);
+	glBindBuffer(GL_TEXTURE_BUFFER, m_paletteBuffer);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_paletteBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+size_t SkinnedCrowd::addInstance(const glm::mat4& model, SkeletalAnimation* clip, float startTime) {
+	size_t index = m_animators.size();
+	m_animators.emplace_back(clip);
+	m_animators.back().UpdateAnimation(startTime);
+	m_instances.push_back({ model, 0.0f, 1.0f, (int32_t)index });
+	m_palettes.resize(m_animators.size() * m_boneCount, glm::mat4(1.0f));
+	m_copiedVersions.push_back(~uint64_t(0));
+	m_instancesDirty = true;
+	return index;
+}
+
+void SkinnedCrowd::setModel(size_t index, const glm::mat4& model) {
+	m_instances[index].Model = model;
+	m_instancesDirty = true;
+}
+
+void SkinnedCrowd::update(float dt, unsigned maxThreads) {
+	std::atomic<bool> changed(false);
+	parallelFor(m_animators.size(), 8, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			m_animators[i].UpdateAnimation(dt);
+			if (m_animators[i].GetPaletteVersion() == m_copiedVersions[i]) {
+				continue;
+			}
+			const auto& palette = m_animators[i].GetFinalBoneMatrices();
+			std::copy_n(palette.begin(), std::min<size_t>(palette.size(), m_boneCount), m_palettes.begin() + i * m_boneCount);
+			m_copiedVersions[i] = m_animators[i].GetPaletteVersion();
+			changed = true;
+		}
+	}, maxThreads);
+	if (changed) {
+		m_palettesDirty = true;
+	}
+}
+
+void SkinnedCrowd::render(sf::RenderWindow& window, ShaderProgram& program, int paletteUnit) {
+	if (m_instancesDirty) {
+		glBindBuffer(GL_ARRAY_BUFFER, m_instanceVbo);
+		glBufferData(GL_ARRAY_BUFFER, m_instances.size() * sizeof(SkeletalInstance), m_instances.data(), GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		m_instancesDirty = false;
+	}
+	if (m_palettesDirty) {
+		// Orphan the old storage so the upload does not wait for draws still reading last frame's palettes.
+		glBindBuffer(GL_TEXTURE_BUFFER, m_paletteBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, m_palettes.size() * sizeof(glm::mat4), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, m_palettes.size() * sizeof(glm::mat4), m_palettes.data());
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		m_palettesDirty = false;
+	}
+	if (m_instances.empty()) {
+		return;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + paletteUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_paletteTexture);
+	program.setUniform("palettes", paletteUnit);
+	program.setUniform("boneCount", m_boneCount);
+	m_object.renderInstanced(window, program, m_instances.size());
+	glActiveTexture(GL_TEXTURE0 + paletteUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
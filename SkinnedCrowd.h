@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <SFML/Graphics.hpp>
+#include <glm/glm.hpp>
+#include "SkeletalObject.h"
+#include "SkeletalAnimator.h"
+#include "ShaderProgram.h"
+
+/**
+ * @brief Many copies of one skeletal model, each with its own SkeletalAnimator, drawn with one instanced
+ * call per mesh through shaders/crowd_skinned.vert. update() runs the animators as parallel jobs that
+ * write straight into one array of palettes. render() uploads it once per frame, however many updates
+ * ran, into a texture buffer that the shader indexes by instance, so the draw call count stays constant
+ * however many characters there are.
+ * Large crowds need a GL_MAX_TEXTURE_BUFFER_SIZE of instances * bones * 4 texels.
+ */
+class SkinnedCrowd {
+private:
+	SkeletalObject& m_object;
+	int m_boneCount;
+	std::vector<SkeletalAnimator> m_animators;
+	std::vector<SkeletalInstance> m_instances;
+	// Every instance's palette, back to back; instance i starts at i * m_boneCount.
+	std::vector<glm::mat4> m_palettes;
+	// The animator palette version last copied into m_palettes, per instance.
+	std::vector<uint64_t> m_copiedVersions;
+	uint32_t m_instanceVbo = 0;
+	uint32_t m_paletteBuffer = 0;
+	uint32_t m_paletteTexture = 0;
+	bool m_instancesDirty = false;
+	bool m_palettesDirty = false;
+
+public:
+	/**
+	 * @param boneCount the palette size of every instance: at least the bone count of every clip played.
+	 */
+	SkinnedCrowd(SkeletalObject& object, int boneCount);
+
+	/**
+	 * @brief Adds an instance playing clip from startTime (in seconds).
+	 * @return the instance's index.
+	 */
+	size_t addInstance(const glm::mat4& model, SkeletalAnimation* clip, float startTime = 0.0f);
+	void setModel(size_t index, const glm::mat4& model);
+	SkeletalAnimator& getAnimator(size_t index) { return m_animators[index]; }
+	size_t size() const { return m_animators.size(); }
+	int getBoneCount() const { return m_boneCount; }
+
+	/**
+	 * @brief Advances every animator by dt on up to maxThreads threads (0 means one per hardware thread).
+	 * The palettes are uploaded by the next render().
+	 */
+	void update(float dt, unsigned maxThreads = 0);
+
+	/**
+	 * @param paletteUnit a texture unit not used by the meshes' own textures or the program's shadow map.
+	 */
+	void render(sf::RenderWindow& window, ShaderProgram& program, int paletteUnit = 5);
+};
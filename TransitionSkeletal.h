@@ -11,7 +11,6 @@
 #include "Skeletal.h"
 #include "SkeletalAnimator.h"
 #include <algorithm>
-#include <glm/gtx/matrix_decompose.hpp>
 
 class TransitionSkeletal 
 {
@@ -23,7 +22,8 @@ private:
 	float end_anim_time;
 
 	std::vector<glm::mat4> m_FinalBoneMatrices;
-	glm::mat4 m_GlobalInverseTransform;
+	SkeletalPose m_StartPose;
+	SkeletalPose m_EndPose;
 
 	float duration;
 
@@ -40,8 +40,6 @@ public:
 
 		start_anim_time = _start_anim_time;
 		end_anim_time = _end_anim_time;
-		
-		m_GlobalInverseTransform = inverse(start_anim->GetRootNode().transformation);
 
 		int size = _start_anim->getBonesSize();
 		m_FinalBoneMatrices.resize(size);
@@ -64,50 +62,14 @@ public:
 	void updateAnimation(float dt) {
 		m_currentTime += dt;
 		if (m_currentTime < duration && m_currentTime >= 0) {
-			CalculateBoneTransform(&start_anim->GetRootNode(), glm::mat4(1.0f));
+			// Blend in TRS space, then build matrices once for the blended pose.
+			start_anim->SamplePose(start_anim_time, m_StartPose);
+			end_anim->SamplePose(end_anim_time, m_EndPose);
+			SkeletalPose::Blend(m_StartPose, m_EndPose, m_currentTime / duration, m_StartPose);
+			start_anim->ComposePose(m_StartPose, m_FinalBoneMatrices);
 		}
 		else {
 			m_currentTime = -1;
 		}
 	}
-
-	// Skeletal Animation Blending --------------------------------------------------------------------------------------------------
-	void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
-	{
-		std::string nodeName = node->name;
-		glm::mat4 nodeTransform = node->transformation;
-
-		Bone* start_bone = start_anim->FindBone(nodeName);
-		Bone* end_bone = end_anim->FindBone(nodeName);
-
-		if (start_bone && end_bone)
-		{
-			glm::mat4 start_translation = start_bone->InterpolatePosition(start_anim_time);
-			glm::quat start_rotation = start_bone->quat_InterpolateRotation(start_anim_time);
-			glm::mat4 start_scale = start_bone->InterpolateScaling(start_anim_time);
-
-			glm::mat4 end_translation = end_bone->InterpolatePosition(end_anim_time);
-			glm::quat end_rotation = end_bone->quat_InterpolateRotation(end_anim_time);
-			glm::mat4 end_scale = end_bone->InterpolateScaling(end_anim_time);
-
-
-			nodeTransform = glm::mix(start_translation, end_translation, m_currentTime / duration)
-				* glm::toMat4(glm::slerp(start_rotation, end_rotation, m_currentTime / duration))
-				* glm::mix(start_scale, end_scale, m_currentTime / duration);
-		}
-
-		glm::mat4 globalTransformation = parentTransform * nodeTransform;
-
-		const auto& boneInfoMap = start_anim->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end())
-		{
-			int index = boneInfoMap.at(nodeName).id;
-			m_FinalBoneMatrices[index] = m_GlobalInverseTransform * globalTransformation * boneInfoMap.at(nodeName).offset;
-		}
-
-		for (int i = 0; i < node->childrenCount; i++)
-			CalculateBoneTransform(&node->children[i], globalTransformation);
-	}
-
-	
 };
\ No newline at end of file
@@ -17,7 +17,17 @@ This application renders a textured mesh that was loaded with Assimp.
 #include "Skeletal.h"
 #include "SkeletalAnimator.h"
 #include <algorithm>
-#include "TransitionSkeletal.h"
+#include "AnimationGraph.h"
+#include <chrono>
+#include "CpuSkinning.h"
+#include "PoseSampling.h"
+#include "AnimationLod.h"
+#include "BakedCrowd.h"
+#include "SkinnedCrowd.h"
+#include "AnimationLibrary.h"
+#include "SkeletalModelAsset.h"
+#include "MotionMatching.h"
+#include "FixedTimestep.h"
 
 
 #define PI glm::pi<float>()
@@ -101,6 +111,42 @@ ShaderProgram shadowMapShader() {
 	return program;
 }
 
+ShaderProgram skinningShader() {
+	ShaderProgram program;
+	try {
+		program.loadTransformFeedback("shaders/skinning.vert", { "skinnedPosition", "skinnedNormal", "skinnedTangent" });
+	}
+	catch (std::runtime_error& e) {
+		std::cout << "ERROR: " << e.what() << std::endl;
+		exit(1);
+	}
+	return program;
+}
+
+ShaderProgram crowdShader() {
+	ShaderProgram program;
+	try {
+		program.load("shaders/crowd.vert", "shaders/lighting.frag");
+	}
+	catch (std::runtime_error& e) {
+		std::cout << "ERROR: " << e.what() << std::endl;
+		exit(1);
+	}
+	return program;
+}
+
+ShaderProgram skinnedCrowdShader() {
+	ShaderProgram program;
+	try {
+		program.load("shaders/crowd_skinned.vert", "shaders/lighting.frag");
+	}
+	catch (std::runtime_error& e) {
+		std::cout << "ERROR: " << e.what() << std::endl;
+		exit(1);
+	}
+	return program;
+}
+
 ShaderProgram skyboxShader() {
 	ShaderProgram program;
 	try {
@@ -233,15 +279,65 @@ void setUpLight(ShaderProgram& program) {
 }
 
 
-void renderSkeletal(sf::RenderWindow& window, ShaderProgram& program, SkeletalObject& obj, std::vector<glm::mat4>& transforms) {
+void renderSkeletal(sf::RenderWindow& window, ShaderProgram& program, SkeletalObject& obj, const std::vector<glm::mat4>& transforms) {
 	program.activate();
 	program.setUniform("skeletal", true);
-	for (int i = 0; i < transforms.size(); ++i)
-		program.setUniform("finalBonesMatrices[" + std::to_string(i) + "]", transforms[i]);
-	obj.render(window, program);
+	obj.render(window, program, transforms);
 	program.setUniform("skeletal", false);
 }
 
+// Skins obj once into its pre-skinned buffers; afterwards every pass renders it with obj.render() as a static mesh.
+void preSkinSkeletal(ShaderProgram& program, const SkeletalObject& obj, const std::vector<glm::mat4>& transforms) {
+	program.activate();
+	glEnable(GL_RASTERIZER_DISCARD);
+	obj.preSkin(program, transforms);
+	glDisable(GL_RASTERIZER_DISCARD);
+}
+
+// Prints CPU skinning timings (scalar vs SIMD vs threaded) for every mesh of obj.
+void benchmarkCpuSkinning(const SkeletalObject& obj, const std::vector<glm::mat4>& palette) {
+	for (auto& mesh : obj.getMeshes())
+		CpuSkinning::Benchmark(mesh.getVertices(), palette);
+	for (size_t i = 0; i < obj.numberOfChildren(); i++)
+		benchmarkCpuSkinning(obj.getChild(i), palette);
+}
+
+
+// Prints the per-frame cost of a transition from one clip to another, crossfaded vs inertialized.
+void benchmarkTransitions(SkeletalAnimation* skeleton, SkeletalAnimation* from, SkeletalAnimation* to, float blendTime) {
+	const float dt = 1.0f / 60.0f;
+	const int transitions = 200;
+	auto time = [&](bool inertialize) {
+		auto states = std::make_unique<StateMachineNode>(inertialize ? 0.0f : blendTime);
+		int from_state = states->addState(std::make_unique<ClipNode>(from));
+		int to_state = states->addState(std::make_unique<ClipNode>(to));
+		StateMachineNode& state_machine = *states;
+		AnimationGraph graph(skeleton, std::move(states));
+
+		double total = 0;
+		int frames = 0;
+		for (int i = 0; i < transitions; i++) {
+			// settle on the source clip first, so no earlier fade is still running
+			state_machine.setState(from_state);
+			for (float t = 0; t < blendTime + 2 * dt; t += dt)
+				graph.UpdateAnimation(dt);
+			// time only the frames inside the transition window
+			auto start = std::chrono::high_resolution_clock::now();
+			state_machine.setState(to_state);
+			if (inertialize)
+				graph.inertialize(blendTime);
+			for (float t = 0; t < blendTime; t += dt, frames++)
+				graph.UpdateAnimation(dt);
+			total += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		}
+		return total / frames;
+	};
+	double crossfadeMs = time(false);
+	double inertializeMs = time(true);
+	std::cout << "Transition cost per frame, " << skeleton->getBonesSize() << " bones, " << blendTime << " s blend\n"
+		<< "  crossfade: " << crossfadeMs << " ms\n"
+		<< "  inertialization: " << inertializeMs << " ms (" << crossfadeMs / inertializeMs << "x)\n";
+}
 
 
 Scene<Object3D> lightScene() {
@@ -433,44 +529,6 @@ void checkCollision(Circle& circle, Wall& wall, glm::vec2* target = nullptr) {
 
 // ---------------------------------------------------------------------------------------------------------------------
 
-// Skeletal Animation Blending --------------------------------------------------------------------------------------------------
-glm::mat4 interpolate(const glm::mat4& start, const glm::mat4& end, float progression) {
-	// Decompose matrices
-	glm::vec3 scaleStart, translationStart, scaleEnd, translationEnd;
-	glm::quat rotationStart, rotationEnd;
-	glm::vec3 skew;
-	glm::vec4 perspective;
-	glm::decompose(start, scaleStart, rotationStart, translationStart, skew, perspective);
-	glm::decompose(end, scaleEnd, rotationEnd, translationEnd, skew, perspective);
-
-	// Interpolate scale, rotation, and translation
-	glm::vec3 scaleInterpolated = glm::mix(scaleStart, scaleEnd, progression);
-	glm::quat rotationInterpolated = glm::slerp(rotationStart, rotationEnd, progression);
-	glm::vec3 translationInterpolated = glm::mix(translationStart, translationEnd, progression);
-
-	// Reconstruct transformation matrix
-	return glm::translate(glm::mat4(1.0f), translationInterpolated) *
-		glm::mat4_cast(rotationInterpolated) *
-		glm::scale(glm::mat4(1.0f), scaleInterpolated);
-}
-
-std::vector<glm::mat4> updateSkeleton(std::vector<glm::mat4>& last_transforms, std::vector<glm::mat4>& transforms, float blendFactor) {
-	std::vector<glm::mat4> globalTransforms(transforms.size());
-	for (int i = 0; i < transforms.size(); ++i) {
-		glm::mat4 transform1 = last_transforms[i];
-		glm::mat4 transform2 = transforms[i];
-		globalTransforms[i] = interpolate(transform1, transform2, blendFactor);
-	}
-
-	return globalTransforms;
-}
-
-
-
-// ---------------------------------------------------------------------------------------------------------------------
-
-
-
 // SkeletalObject is same as Object3D, except SkeletalObject has bones array for skeletal animation.
 int main() {
 	// Initialize the window and OpenGL.
@@ -522,11 +580,45 @@ int main() {
 
 	setUpLight(skeletal_shader);
 
+	// Skin characters once per frame and share the result between the shadow and lighting passes,
+	// instead of skinning in both vertex shaders (and six times over in the shadow geometry shader).
+	bool pre_skinning = true;
+	ShaderProgram skinning_shader = skinningShader();
+	// Skin on the CPU instead, for software GL where vertex shader skinning is very slow.
+	bool cpu_skinning = false;
+	bool run_skinning_benchmark = false;
+	// Compress animation keys at load; prints memory saved and the largest error per clip.
+	bool compress_animations = true;
+	// Resample animation channels at a fixed rate instead: faster to sample, but larger.
+	bool resample_animations = false;
+	bool run_sampling_benchmark = false;
+	bool run_compose_benchmark = false;
+
 
 	// vampire1 dance -----------------------------------------------------------------------------------------------
 	Skeletal vampire1_model("models/vampire/dancing_vampire.dae", true);
-	SkeletalAnimation vampire1_dance("models/vampire/dancing_vampire.dae", &vampire1_model);
+	// Clips are imported once per file and shared by every model with the same skeleton.
+	AnimationLibrary animation_library;
+	SkeletalAnimation& vampire1_dance = *animation_library.load("models/vampire/dancing_vampire.dae", &vampire1_model).front();
+	if (resample_animations) {
+		vampire1_dance.Resample();
+	}
+	else if (compress_animations) {
+		vampire1_dance.Compress();
+	}
 	SkeletalAnimator vampire1_animator(&vampire1_dance);
+	// Characters playing the same clip in step share one palette per frame.
+	AnimationPoseCache pose_cache;
+	bool use_pose_cache = true;
+	bool report_pose_cache = false;
+	if (use_pose_cache) {
+		vampire1_animator.setPoseCache(&pose_cache);
+	}
+	// Far and off-screen characters update less often and with fewer bones.
+	bool animation_lod = true;
+	bool report_animation_lod = false;
+	AnimationLodPolicy animation_lod_policy;
+	AnimationLod vampire1_lod(&animation_lod_policy, &vampire1_animator);
 	auto& vampire1 = vampire1_model.getRoot();
 	vampire1.addTexture(loadTexture("models/vampire/textures/Vampire_normal.png", "normalMap"));
 
@@ -534,6 +626,48 @@ int main() {
 	vampire1.move(glm::vec3(7.5, 0, 25));
 	vampire1.rotate(glm::vec3(0, PI, 0));
 
+	// spawned dancers: instances of one shared asset, each just a transform and an animator ----------------------
+	int spawned_dancers = 0;
+	std::shared_ptr<SkeletalModelAsset> dancer_asset;
+	std::vector<SkeletalModelInstance> dancers;
+	if (spawned_dancers > 0) {
+		dancer_asset = std::make_shared<SkeletalModelAsset>("models/vampire/dancing_vampire.dae", true);
+		dancer_asset->getSkeletal().getRoot().addTexture(loadTexture("models/vampire/textures/Vampire_normal.png", "normalMap"));
+		SkeletalAnimation* dancer_clip = animation_library.load("models/vampire/dancing_vampire.dae", &dancer_asset->getSkeletal()).front();
+		glm::mat4 dancer_base = glm::scale(glm::rotate(glm::mat4(1.0f), (float)PI, glm::vec3(0, 1, 0)), glm::vec3(1.3f));
+		for (int i = 0; i < spawned_dancers; i++) {
+			glm::mat4 place = glm::translate(glm::mat4(1.0f), glm::vec3(4.5f - 3.0f * i, 0, 25)) * dancer_base;
+			dancers.emplace_back(dancer_asset, dancer_clip, place);
+			dancers.back().getAnimator().setPoseCache(use_pose_cache ? &pose_cache : nullptr);
+		}
+	}
+
+	// baked crowd: background dancers playing a palette texture, one draw call per mesh -----------------------------
+	bool baked_crowd = false;
+	int crowd_rows = 4, crowd_columns = 8;
+	ShaderProgram crowd_shader = crowdShader();
+	crowd_shader.activate();
+	crowd_shader.setUniform("projection", perspective);
+	setUpLight(crowd_shader);
+	std::unique_ptr<Skeletal> crowd_model;
+	std::unique_ptr<AnimationTexture> crowd_dance;
+	std::unique_ptr<BakedCrowd> crowd;
+	if (baked_crowd) {
+		crowd_model = std::make_unique<Skeletal>("models/vampire/dancing_vampire.dae", true);
+		crowd_model->getRoot().addTexture(loadTexture("models/vampire/textures/Vampire_normal.png", "normalMap"));
+		crowd_model->getRoot().grow(glm::vec3(1.3, 1.3, 1.3));
+		crowd_model->getRoot().rotate(glm::vec3(0, PI, 0));
+		crowd_dance = std::make_unique<AnimationTexture>(vampire1_dance);
+		crowd = std::make_unique<BakedCrowd>(crowd_model->getRoot(), *crowd_dance);
+		for (int row = 0; row < crowd_rows; row++) {
+			for (int column = 0; column < crowd_columns; column++) {
+				glm::mat4 place = glm::translate(glm::mat4(1.0f), glm::vec3(2.0f * column, 0, 29.0f + 2.0f * row));
+				// Spread the phases so neighbours do not move in lockstep.
+				crowd->addInstance(place, crowd_dance->getDuration() * ((row * crowd_columns + column) * 0.37f), 0.9f + 0.05f * (column % 4));
+			}
+		}
+	}
+
 
 
 	// vampire -----------------------------------------------------------------------------------------------------
@@ -542,31 +676,108 @@ int main() {
 
 	Skeletal skeletal_model("models/Standing Run Forward/Standing Run Forward.dae", true);
 
-	SkeletalAnimation walking_animation("models/Standing Run Forward/Standing Run Forward.dae", &skeletal_model);
-	SkeletalAnimator walking_animator(&walking_animation);
+	SkeletalAnimation& walking_animation = *animation_library.load("models/Standing Run Forward/Standing Run Forward.dae", &skeletal_model).front();
+	SkeletalAnimation& idle_animation = *animation_library.load("models/Standing Run Forward/Idle.dae", &skeletal_model).front();
+	SkeletalAnimation& jump_animation = *animation_library.load("models/Standing Run Forward/Jump.dae", &skeletal_model).front();
+	if (run_sampling_benchmark) {
+		PoseSampling::Benchmark(walking_animation);
+	}
+	if (resample_animations) {
+		walking_animation.Resample();
+		idle_animation.Resample();
+		jump_animation.Resample();
+	}
+	else if (compress_animations) {
+		walking_animation.Compress();
+		idle_animation.Compress();
+		jump_animation.Compress();
+	}
 
-	SkeletalAnimation idle_animation("models/Standing Run Forward/Idle.dae", &skeletal_model);
-	SkeletalAnimator idle_animator(&idle_animation);
+	// Palette versions already skinned into the pre-skinned buffers; skinning is skipped while they hold.
+	uint64_t vampire_skinned_version = ~uint64_t(0), vampire1_skinned_version = ~uint64_t(0);
 
-	SkeletalAnimation jump_animation("models/Standing Run Forward/Jump.dae", &skeletal_model);
-	SkeletalAnimator jump_animator(&jump_animation);
-	jump_animator.setRepeat(false);
+	// Inertialized transitions cut to the new state and decay the difference, so only the new clip is
+	// sampled during the transition; otherwise states crossfade and both clips are sampled.
+	bool inertialized_transitions = true;
+	bool run_transition_benchmark = false;
+	float vampire_transition_time = 0.2f;
 
-	std::vector<glm::mat4> vampire_transforms;
+	// Root motion: walking moves the vampire as far as the clip's root travels instead of by vampire_velocity.
+	// The steering below still turns it, so only the travel is extracted.
+	bool root_motion = false;
+	if (root_motion) {
+		walking_animation.EnableRootMotion(false);
+	}
 
-	// number of skeletal animation: 3
-	// 0: walking, 1:idle, 2:jump
-	std::vector<SkeletalAnimation*> vampire_animation_list = {
-		&walking_animation, &idle_animation, &jump_animation
-	};
-	std::vector<SkeletalAnimator*> vampire_animator_list = {
-		&walking_animator, & idle_animator, & jump_animator
-	};
+	// Animation events: the clips' footsteps and the jump's take-off reach a queue drained once per frame.
+	// The times are fractions of each clip, picked by eye.
+	enum VampireEvent { FOOTSTEP_LEFT, FOOTSTEP_RIGHT, JUMP_TAKEOFF };
+	bool report_animation_events = false;
+	AnimationEventQueue vampire_events;
+	walking_animation.AddEvent(0.0f, FOOTSTEP_LEFT);
+	walking_animation.AddEvent(walking_animation.GetDuration() * 0.5f, FOOTSTEP_RIGHT);
+	jump_animation.AddEvent(jump_animation.GetDuration() * 0.3f, JUMP_TAKEOFF);
+
+	// states of the vampire
+	auto vampire_states = std::make_unique<StateMachineNode>(inertialized_transitions ? 0.0f : vampire_transition_time);
+	auto walking_node = std::make_unique<ClipNode>(&walking_animation);
+	auto jump_node = std::make_unique<ClipNode>(&jump_animation, false);
+	walking_node->setEventQueue(&vampire_events);
+	jump_node->setEventQueue(&vampire_events);
+	int walking_state = vampire_states->addState(std::move(walking_node));
+	int idle_state = vampire_states->addState(std::make_unique<ClipNode>(&idle_animation));
+	int jump_state = vampire_states->addState(std::move(jump_node), true);
+
+	// Motion matching: one locomotion state picks its next frame from a database of the walking and idle clips,
+	// by where desired_direction asks the vampire to go, instead of switching between the two states.
+	bool motion_matching = false;
+	bool run_motion_matching_benchmark = false;
+	float_t vampire_velocity = 4;
+	MotionDatabase motion_database;
+	MotionMatchingNode* motion_node = nullptr;
+	int locomotion_state = -1;
+	if (motion_matching) {
+		// Without root motion the walking clip runs in place, at vampire_velocity along the model's forward axis.
+		motion_database.addClip(&walking_animation, true, root_motion ? glm::vec3(0) : glm::vec3(0, 0, vampire_velocity));
+		motion_database.addClip(&idle_animation, true);
+		motion_database.build();
+		if (run_motion_matching_benchmark) {
+			motion_database.Benchmark();
+		}
+		auto locomotion = std::make_unique<MotionMatchingNode>(&motion_database);
+		motion_node = locomotion.get();
+		locomotion_state = vampire_states->addState(std::move(locomotion));
+	}
+	vampire_states->setState(motion_matching ? locomotion_state : idle_state);
+	StateMachineNode& vampire_state_machine = *vampire_states;
+	AnimationGraph vampire_animation_graph(&jump_animation, std::move(vampire_states));
+	if (run_transition_benchmark) {
+		benchmarkTransitions(&jump_animation, &idle_animation, &walking_animation, vampire_transition_time);
+	}
 
-	int current_skeletal_anim = 1,
-		last_skeletal_anim = 1;
-	
-	TransitionSkeletal trans_skeletal = TransitionSkeletal(0.2f);
+	// skinned crowd: live-animated copies, each with its own animator, palettes in a texture buffer ---------------
+	bool skinned_crowd = false;
+	int skinned_crowd_rows = 4, skinned_crowd_columns = 8;
+	ShaderProgram skinned_crowd_shader = skinnedCrowdShader();
+	skinned_crowd_shader.activate();
+	skinned_crowd_shader.setUniform("projection", perspective);
+	setUpLight(skinned_crowd_shader);
+	std::unique_ptr<Skeletal> skinned_crowd_model;
+	std::unique_ptr<SkinnedCrowd> skinned_crowd_instances;
+	if (skinned_crowd) {
+		skinned_crowd_model = std::make_unique<Skeletal>("models/Standing Run Forward/Standing Run Forward.dae", true);
+		skinned_crowd_instances = std::make_unique<SkinnedCrowd>(skinned_crowd_model->getRoot(), skeletal_model.GetBoneCount());
+		for (int row = 0; row < skinned_crowd_rows; row++) {
+			for (int column = 0; column < skinned_crowd_columns; column++) {
+				glm::mat4 place = glm::translate(glm::mat4(1.0f), glm::vec3(20.0f + 2.0f * column, 0, 2.0f * row));
+				// The crowd's model has the same skeleton, so the library hands back the player's clips.
+				SkeletalAnimation* clip = animation_library.load((row + column) % 2 == 0
+					? "models/Standing Run Forward/Standing Run Forward.dae" : "models/Standing Run Forward/Idle.dae",
+					skinned_crowd_model.get()).front();
+				skinned_crowd_instances->addInstance(place, clip, 0.13f * (row * skinned_crowd_columns + column));
+			}
+		}
+	}
 
 
 	auto& vampire = skeletal_model.getRoot();
@@ -575,13 +786,27 @@ int main() {
 	//vampire.grow(glm::vec3(vampire_scale, vampire_scale, vampire_scale));
 	vampire.setMass(10);
 
+	if (pre_skinning || cpu_skinning) {
+		vampire.enablePreSkinning();
+		vampire1.enablePreSkinning();
+	}
+	if (run_skinning_benchmark) {
+		vampire1_animator.UpdateAnimation(0);
+		benchmarkCpuSkinning(vampire1, vampire1_animator.GetFinalBoneMatrices());
+	}
+	if (run_compose_benchmark) {
+		vampire1_animator.UpdateAnimation(0);
+		HierarchyCompose::Benchmark(vampire1_dance, vampire1_animator.GetPose());
+	}
+
 
 	float_t vampire_height = 2;
-	float_t vampire_velocity = 4;
+	// The take-off the old per-frame jump force gave at 60 FPS.
+	float_t vampire_jump_impulse = 10000.0f / 60.0f;
 	glm::vec3 vampire_forward = glm::vec3(0, 0, 1);
 
 	
-	glm::vec3 desired_direction;
+	glm::vec3 desired_direction(0);
 	Animator<SkeletalObject> rotate_vampire;
 	rotate_vampire.addAnimation(
 		[&vampire, &vampire_forward, &desired_direction]() {
@@ -739,7 +964,14 @@ int main() {
 		move_forward = false,
 		move_backward = false,
 		jumping = false;
-	auto last_gravity_time = c.getElapsedTime();
+
+	// Fixed-step simulation (see FixedTimestep), and a once-a-second frame rate report.
+	FixedTimestep sim_clock(60.0f);
+	InterpolatedPalette vampire_render_palette, vampire1_render_palette;
+	bool report_frame_rate = false;
+	int reported_frames = 0;
+	uint64_t reported_steps = 0;
+	auto last_frame_report = c.getElapsedTime();
 
 	auto last = c.getElapsedTime();
 	while (running) {
@@ -790,7 +1022,192 @@ int main() {
 		auto diff = now - last;
 		auto diffSeconds = diff.asSeconds();
 		last = now;
-		std::cout << 1 / diff.asSeconds() << " FPS " << std::endl;
+
+
+		// simulation -------------------------------------------------------------------------------------------------------------------------------------
+		// Physics, steering and animation advance in fixed steps however fast frames render; the frame then
+		// draws the vampires between the last two steps.
+		int sim_steps = sim_clock.advance(diffSeconds);
+		// Per-frame bookkeeping, once before the steps. A frame without steps skips it, so the cache does not
+		// evict entries that nothing had a chance to request.
+		if (sim_steps > 0) {
+			if (report_pose_cache && pose_cache.getFrameHits() + pose_cache.getFrameMisses() > 0) {
+				std::cout << "Pose cache: " << pose_cache.getFrameHits() << " hits, " << pose_cache.getFrameMisses() << " misses, "
+					<< pose_cache.getEntryCount() << " entries, " << pose_cache.getHitRate() * 100 << "% hit rate overall" << std::endl;
+			}
+			pose_cache.beginFrame();
+			if (report_animation_lod) {
+				const AnimationLodStats& lod_stats = animation_lod_policy.getFrameStats();
+				std::cout << "Animation LOD: " << lod_stats.updates << " updates, " << lod_stats.skippedUpdates << " skipped, "
+					<< lod_stats.offscreen << " off-screen, " << lod_stats.prunedBones << " bones pruned, "
+					<< lod_stats.interpolatedPalettes << " palettes interpolated" << std::endl;
+			}
+			animation_lod_policy.beginFrame(glm::mat4(perspective) * camera, camera_pos);
+		}
+		for (int sim_step = 0; sim_step < sim_steps; sim_step++) {
+			float stepSeconds = sim_clock.getStep();
+			vampire.storePreviousState();
+
+			// control character -----------------------------------------------------------------------------------------------------------------------------
+			if ((!move_left && !move_right && !move_forward && !move_backward) || jumping) {
+				moving = false;
+			}
+			else {
+				moving = true;
+			}
+
+			// pick the state; a change crossfades or inertializes
+			int vampire_state = motion_matching ? locomotion_state : idle_state;
+			if (vampire.getPosition().y > 0) {
+				vampire_state = jump_state;
+			}
+			else if (moving && !motion_matching) {
+				vampire_state = walking_state;
+			}
+			if (vampire_state_machine.setState(vampire_state) && inertialized_transitions) {
+				vampire_animation_graph.inertialize(vampire_transition_time);
+			}
+			if (motion_node) {
+				// The goal in the vampire's model space; its model matrix only rotates and translates.
+				motion_node->setGoal(glm::transpose(glm::mat3(vampire.getModelMatrix())) * (desired_direction * vampire_velocity));
+				if (motion_node->Search() && inertialized_transitions) {
+					vampire_animation_graph.inertialize(vampire_transition_time);
+				}
+			}
+			vampire_animation_graph.UpdateAnimation(stepSeconds);
+			if (root_motion) {
+				vampire.addRootMotion(vampire_animation_graph.GetRootMotion());
+			}
+			FiredAnimationEvent vampire_event;
+			while (vampire_events.pop(vampire_event)) {
+				if (report_animation_events) {
+					std::cout << "Animation event " << vampire_event.event.id << " at tick " << vampire_event.event.time << std::endl;
+				}
+			}
+			vampire_render_palette.push(vampire_animation_graph.GetFinalBoneMatrices(), vampire_animation_graph.GetPaletteVersion());
+
+
+			//if (moving && jump_vampire.finish()) {
+			//	walking_animator.UpdateAnimation(stepSeconds);
+			//}
+			//else {
+			//	walking_animator.resetAnimation();
+			//}
+			//if (jumping) {
+			//	if (jump_vampire.finish()) {
+			//		jump_vampire.start();
+			//	}
+			//}
+			//jump_vampire.tick(stepSeconds);
+
+
+			glm::vec3 forward_cam = target - camera_pos;
+			forward_cam.y = 0;
+			forward_cam = glm::normalize(forward_cam);
+			glm::vec3 right_cam = glm::cross(forward_cam, up_vector);
+			right_cam.y = 0;
+			right_cam = glm::normalize(right_cam);
+
+
+			desired_direction = glm::vec3(0);
+			if (move_forward) {
+				//vampire.move(forward_cam* vampire_velocity* diff.asSeconds());
+				desired_direction += forward_cam;
+			}
+			else if (move_backward) {
+				//vampire.move(-forward_cam * vampire_velocity * diff.asSeconds());
+				desired_direction -= forward_cam;
+			}
+
+			if (move_right) {
+				//vampire.move(right_cam* vampire_velocity* diff.asSeconds());
+				desired_direction += right_cam;
+			}
+			else if (move_left) {
+				//vampire.move(-right_cam * vampire_velocity * diff.asSeconds());
+				desired_direction -= right_cam;
+			}
+
+			auto vampire_velocity_y = vampire.getVelocity().y;
+			glm::vec3 vampire_walk_velocity = root_motion ? glm::vec3(0) : desired_direction * vampire_velocity;
+			vampire.setVelocity(glm::vec3(0, vampire_velocity_y, 0) + vampire_walk_velocity);
+
+			if (desired_direction.x != 0 || desired_direction.z != 0) {
+				if (rotate_vampire.finish()) {
+					rotate_vampire.start();
+				}
+			}
+
+			rotate_vampire.tick(stepSeconds);
+
+
+			// Gravity and the jump act once per step. The take-off is an impulse, so the jump height does not
+			// depend on the step length.
+			vampire.addForce(glm::vec3(0, -9.8, 0) * vampire.getMass());
+			if (jumping && vampire.getPosition().y == 0) {
+				vampire.addForce(glm::vec3(0, vampire_jump_impulse / stepSeconds, 0));
+				jumping = false;
+			}
+			vampire.tick(stepSeconds);
+
+			// when on ground, position.y and velocity.y should be 0
+			auto vampire_pos = vampire.getPosition();
+			if (vampire_pos.y <= 0.005) {
+				vampire_pos.y = 0;
+				vampire.setPosition(vampire_pos);
+				auto vampire_vel = vampire.getVelocity();
+				vampire_vel.y =  0.0;
+				vampire.setVelocity(vampire_vel);
+			}
+
+			// character collide with wall ---------------------------------------------------------------------------------------------------------
+			Circle vampire_circle = { {vampire_pos.x, vampire_pos.z}, 0.5f };
+			for (auto& wall : walls) {
+				checkCollision(vampire_circle, wall);
+			}
+			vampire_pos.x = vampire_circle.center.x;
+			vampire_pos.z = vampire_circle.center.y;
+			vampire.setPosition(vampire_pos);
+
+
+			// skeletal animator-----------------------------------------------------------------------------------------------------------------------------
+
+			if (animation_lod) {
+				const std::vector<glm::mat4>& palette = vampire1_lod.update(stepSeconds, vampire1.getPosition() + glm::vec3(0, 1.2, 0), 1.5f);
+				vampire1_render_palette.push(palette, vampire1_lod.getPaletteVersion());
+			}
+			else {
+				vampire1_animator.UpdateAnimation(stepSeconds);
+				vampire1_render_palette.push(vampire1_animator.GetFinalBoneMatrices(), vampire1_animator.GetPaletteVersion());
+			}
+			if (skinned_crowd_instances) {
+				skinned_crowd_instances->update(stepSeconds);
+			}
+			for (auto& dancer : dancers) {
+				dancer.update(stepSeconds);
+			}
+
+			// rotate sky slowly
+			skybox_anim.tick(stepSeconds);
+		}
+		float sim_alpha = sim_clock.getAlpha();
+		vampire.interpolateRender(sim_alpha);
+		const std::vector<glm::mat4>& vampire_transforms = vampire_render_palette.get(sim_alpha);
+		uint64_t vampire_version = vampire_render_palette.getVersion();
+		const std::vector<glm::mat4>& vampire1_transforms = vampire1_render_palette.get(sim_alpha);
+		uint64_t vampire1_version = vampire1_render_palette.getVersion();
+
+		if (report_frame_rate) {
+			reported_frames++;
+			float report_seconds = (now - last_frame_report).asSeconds();
+			if (report_seconds >= 1.0f) {
+				std::cout << reported_frames / report_seconds << " FPS, "
+					<< (sim_clock.getStepCount() - reported_steps) / report_seconds << " simulation steps per second" << std::endl;
+				reported_frames = 0;
+				reported_steps = sim_clock.getStepCount();
+				last_frame_report = now;
+			}
+		}
 
 
 		
@@ -811,7 +1228,7 @@ int main() {
 			elevation = std::max(-glm::half_pi<float>() + 0.01f, std::min(glm::half_pi<float>() - 0.01f, elevation));
 			
 			
-			target = vampire.getPosition();
+			target = vampire.getRenderPosition();
 			target.y += vampire_height;
 			camera_pos = glm::vec3(
 				target.x + radius * cos(elevation) * sin(azimuth),
@@ -844,6 +1261,12 @@ int main() {
 		skeletal_shader.activate();
 		skeletal_shader.setUniform("view", camera);
 		skeletal_shader.setUniform("viewPos", camera_pos);
+		crowd_shader.activate();
+		crowd_shader.setUniform("view", camera);
+		crowd_shader.setUniform("viewPos", camera_pos);
+		skinned_crowd_shader.activate();
+		skinned_crowd_shader.setUniform("view", camera);
+		skinned_crowd_shader.setUniform("viewPos", camera_pos);
 		
 
 		
@@ -851,153 +1274,6 @@ int main() {
 
 
 
-		// control character -----------------------------------------------------------------------------------------------------------------------------
-		
-
-
-		
-		if ((!move_left && !move_right && !move_forward && !move_backward) || jumping) {
-			moving = false;
-		}
-		else {
-			moving = true;
-		}
-
-		// blend skeletal animation if there is transition
-		if (trans_skeletal.finish()) {
-			if (moving && vampire.getPosition().y == 0) {
-				walking_animator.UpdateAnimation(diffSeconds);
-				//vampire_transforms = walking_animator.GetFinalBoneMatrices();
-				current_skeletal_anim = 0;
-			}
-			else {
-				//walking_animator.resetAnimation();
-				idle_animator.UpdateAnimation(diffSeconds);
-				//vampire_transforms = idle_animator.GetFinalBoneMatrices();
-				current_skeletal_anim = 1;
-			}
-
-			if (vampire.getPosition().y > 0) {
-				jump_animator.UpdateAnimation(diffSeconds);
-				//vampire_transforms = jump_animator.GetFinalBoneMatrices();
-				current_skeletal_anim = 2;
-			}
-			else {
-				jump_animator.resetAnimation();
-			}
-
-			if (current_skeletal_anim != last_skeletal_anim) {
-				trans_skeletal.setAnimTransforms(
-					vampire_animation_list[last_skeletal_anim], vampire_animation_list[current_skeletal_anim], 
-					vampire_animator_list[last_skeletal_anim]->getCurrentTime(), vampire_animator_list[current_skeletal_anim]->getCurrentTime()
-				);
-				trans_skeletal.start();
-				last_skeletal_anim = current_skeletal_anim;
-			}
-			else {
-				vampire_transforms = vampire_animator_list[current_skeletal_anim]->GetFinalBoneMatrices();
-			}
-
-		}
-		else {
-			trans_skeletal.updateAnimation(diffSeconds);
-			vampire_transforms = trans_skeletal.GetFinalBoneMatrices();
-		}
-		
-		
-		//if (moving && jump_vampire.finish()) {
-		//	walking_animator.UpdateAnimation(diffSeconds);
-		//}
-		//else {
-		//	walking_animator.resetAnimation();
-		//}
-		//if (jumping) {
-		//	if (jump_vampire.finish()) {
-		//		jump_vampire.start();
-		//	}
-		//}
-		//jump_vampire.tick(diffSeconds);
-
-
-		glm::vec3 forward_cam = target - camera_pos;
-		forward_cam.y = 0;
-		forward_cam = glm::normalize(forward_cam);
-		glm::vec3 right_cam = glm::cross(forward_cam, up_vector);
-		right_cam.y = 0;
-		right_cam = glm::normalize(right_cam);
-
-
-		desired_direction = glm::vec3(0);
-		if (move_forward) {
-			//vampire.move(forward_cam* vampire_velocity* diff.asSeconds());
-			desired_direction += forward_cam;
-		}
-		else if (move_backward) {
-			//vampire.move(-forward_cam * vampire_velocity * diff.asSeconds());
-			desired_direction -= forward_cam;
-		}
-			
-		if (move_right) {
-			//vampire.move(right_cam* vampire_velocity* diff.asSeconds());
-			desired_direction += right_cam;
-		}
-		else if (move_left) {
-			//vampire.move(-right_cam * vampire_velocity * diff.asSeconds());
-			desired_direction -= right_cam;
-		}
-
-		auto vampire_velocity_y = vampire.getVelocity().y;
-		vampire.setVelocity(glm::vec3(0, vampire_velocity_y, 0) + desired_direction * vampire_velocity);
-
-		if (desired_direction.x != 0 || desired_direction.z != 0) {
-			if (rotate_vampire.finish()) {
-				rotate_vampire.start();
-			}
-		}
-
-		rotate_vampire.tick(diffSeconds);
-
-
-		// try to fix different jump height - not working
-		if ((now - last_gravity_time).asMilliseconds() >= 2.0f) {
-			vampire.addForce(glm::vec3(0, -9.8, 0) * vampire.getMass());
-			
-			if (jumping && vampire.getPosition().y == 0) {
-				
-				vampire.addForce(glm::vec3(0, 10000, 0));
-				jumping = false;
-			}
-			//std::cout << vampire.getPosition() << "\n";
-			// 
-			//if (trans_skeletal.finish()) {
-			//	vampire.tick((now - last_gravity_time).asSeconds());
-			//}
-			vampire.tick((now - last_gravity_time).asSeconds());
-				
-			last_gravity_time = now;
-		}
-		
-		// when on ground, position.y and velocity.y should be 0
-		auto vampire_pos = vampire.getPosition();
-		if (vampire_pos.y <= 0.005) {
-			vampire_pos.y = 0;
-			vampire.setPosition(vampire_pos);
-			auto vampire_vel = vampire.getVelocity();
-			vampire_vel.y =  0.0;
-			vampire.setVelocity(vampire_vel);
-		}
-
-		// character collide with wall ---------------------------------------------------------------------------------------------------------
-		Circle vampire_circle = { {vampire_pos.x, vampire_pos.z}, 0.5f };
-		for (auto& wall : walls) {
-			checkCollision(vampire_circle, wall);
-		}
-		vampire_pos.x = vampire_circle.center.x;
-		vampire_pos.z = vampire_circle.center.y;
-		vampire.setPosition(vampire_pos);
-
-
-
 		// light cube --------------------------------------------------------------
 		light_cube.setPosition(glm::vec3(
 			target.x + 1,
@@ -1007,10 +1283,22 @@ int main() {
 
 		
 
-		// skeletal animator-----------------------------------------------------------------------------------------------------------------------------
-		
-		vampire1_animator.UpdateAnimation(diffSeconds);
-		auto vampire1_transforms = vampire1_animator.GetFinalBoneMatrices();
+		if (cpu_skinning || pre_skinning) {
+			if (vampire_version != vampire_skinned_version) {
+				if (cpu_skinning)
+					vampire.cpuSkin(vampire_transforms);
+				else
+					preSkinSkeletal(skinning_shader, vampire, vampire_transforms);
+				vampire_skinned_version = vampire_version;
+			}
+			if (vampire1_version != vampire1_skinned_version) {
+				if (cpu_skinning)
+					vampire1.cpuSkin(vampire1_transforms);
+				else
+					preSkinSkeletal(skinning_shader, vampire1, vampire1_transforms);
+				vampire1_skinned_version = vampire1_version;
+			}
+		}
 
 		
 		// render to create depth map (shadow map)--------------------------------------------------------------------------------------------------------
@@ -1040,8 +1328,17 @@ int main() {
 
 		glCullFace(GL_FRONT);
 
-		renderSkeletal(window, shadow_shader, vampire, vampire_transforms);
-		renderSkeletal(window, shadow_shader, vampire1, vampire1_transforms);
+		if (pre_skinning || cpu_skinning) {
+			vampire.render(window, shadow_shader);
+			vampire1.render(window, shadow_shader);
+		}
+		else {
+			renderSkeletal(window, shadow_shader, vampire, vampire_transforms);
+			renderSkeletal(window, shadow_shader, vampire1, vampire1_transforms);
+		}
+		for (auto& dancer : dancers) {
+			dancer.render(window, shadow_shader);
+		}
 
 		ground.render(window, shadow_shader);
 		//tiger.render(window, shadow_shader);
@@ -1071,12 +1368,42 @@ int main() {
 
 
 
-		renderSkeletal(window, skeletal_shader, vampire, vampire_transforms);
-		renderSkeletal(window, skeletal_shader, vampire1, vampire1_transforms);
+		if (pre_skinning || cpu_skinning) {
+			vampire.render(window, skeletal_shader);
+			vampire1.render(window, skeletal_shader);
+		}
+		else {
+			renderSkeletal(window, skeletal_shader, vampire, vampire_transforms);
+			renderSkeletal(window, skeletal_shader, vampire1, vampire1_transforms);
+		}
+		for (auto& dancer : dancers) {
+			dancer.render(window, skeletal_shader);
+		}
 
 		ground.render(window, skeletal_shader);
 		//tiger.render(window, skeletal_shader);
 
+		if (crowd) {
+			crowd_shader.activate();
+			crowd_shader.setUniform("lightPos", light_cube.getPosition());
+			crowd_shader.setUniform("far_plane", far_plane);
+			glActiveTexture(GL_TEXTURE0 + 4);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
+			crowd_shader.setUniform("depthMap", 4);
+			crowd->render(window, crowd_shader, now.asSeconds());
+			skeletal_shader.activate();
+		}
+		if (skinned_crowd_instances) {
+			skinned_crowd_shader.activate();
+			skinned_crowd_shader.setUniform("lightPos", light_cube.getPosition());
+			skinned_crowd_shader.setUniform("far_plane", far_plane);
+			glActiveTexture(GL_TEXTURE0 + 4);
+			glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
+			skinned_crowd_shader.setUniform("depthMap", 4);
+			skinned_crowd_instances->render(window, skinned_crowd_shader);
+			skeletal_shader.activate();
+		}
+
 
 		for (auto& wall : walls) {
 			wall.wall_object.render(window, skeletal_shader);
@@ -1108,9 +1435,6 @@ int main() {
 		glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxCubeMap);
 		skybox_shader.setUniform("skybox", 5);
 		
-		// rotate sky slowly
-		skybox_anim.tick(diffSeconds);
-
 		skybox.render(window, skybox_shader);
 		
 		glDepthFunc(GL_LESS);
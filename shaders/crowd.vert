@@ -0,0 +1,74 @@
+#version 430 core
+// Skins instanced copies of a mesh with bone palettes baked into a texture (see AnimationTexture).
+// Each instance brings its own placement and playback timing, so a whole crowd is one draw call.
+layout (location = 0) in vec3 vPosition;
+layout (location = 1) in vec3 vNormal;
+layout (location = 2) in vec2 vTexCoord;
+layout (location = 3) in vec3 vTangent;
+layout(location = 4) in ivec4 boneIds;
+layout(location = 5) in vec4 weights;
+// influences 5-8, only read when boneInfluences is 8 (see SkeletalMesh.h)
+layout(location = 12) in ivec4 boneIds2;
+layout(location = 13) in vec4 weights2;
+// Per instance; must match SkeletalInstance in SkeletalMesh.h.
+layout(location = 6) in mat4 instanceModel;
+layout(location = 10) in vec2 instanceTime; // offset in seconds, speed
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+
+// One row per frame, four texels (matrix columns) per bone.
+uniform sampler2D animationTexture;
+uniform int animationFrames;
+uniform float animationFramesPerSecond;
+uniform float animationTime;
+
+// The model bone id of each of the mesh's bone indices; size must match MAX_MESH_PALETTE in SkeletalMesh.h.
+uniform int meshBones[64];
+uniform int boneInfluences;
+
+out vec2 TexCoord;
+out vec3 Normal;
+out vec3 FragWorldPos;
+out mat3 TBN;
+
+mat4 bakedBone(int bone, int frame)
+{
+    return mat4(texelFetch(animationTexture, ivec2(bone * 4, frame), 0),
+                texelFetch(animationTexture, ivec2(bone * 4 + 1, frame), 0),
+                texelFetch(animationTexture, ivec2(bone * 4 + 2, frame), 0),
+                texelFetch(animationTexture, ivec2(bone * 4 + 3, frame), 0));
+}
+
+void main()
+{
+    // Blend the two baked frames around this instance's time; the last frame wraps to the first.
+    float frameTime = mod((animationTime * instanceTime.y + instanceTime.x) * animationFramesPerSecond, float(animationFrames));
+    int frame = int(frameTime);
+    int next = (frame + 1) % animationFrames;
+    float alpha = frameTime - float(frame);
+
+    // Influences are sorted by weight, so the first zero weight ends them.
+    mat4 boneTransform = mat4(0.0);
+    for (int i = 0; i < 8 && i < boneInfluences; i++) {
+        float weight = i < 4 ? weights[i] : weights2[i - 4];
+        if (weight == 0.0)
+            break;
+        int bone = meshBones[i < 4 ? boneIds[i] : boneIds2[i - 4]];
+        boneTransform += mix(bakedBone(bone, frame), bakedBone(bone, next), alpha) * weight;
+    }
+
+    mat4 world = instanceModel * model;
+    vec4 worldPosition = world * boneTransform * vec4(vPosition, 1.0);
+    gl_Position = projection * view * worldPosition;
+    TexCoord = vTexCoord;
+    FragWorldPos = vec3(worldPosition);
+
+    mat3 normalMatrix = transpose(inverse(mat3(world) * mat3(boneTransform)));
+    vec3 N = normalize(normalMatrix * vNormal);
+    vec3 T = normalize(normalMatrix * vTangent);
+    vec3 B = normalize(cross(N, T));
+    Normal = N;
+    TBN = mat3(T, B, N);
+}
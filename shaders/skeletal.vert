@@ -6,6 +6,9 @@ layout (location = 2) in vec2 vTexCoord;
 layout (location = 3) in vec3 vTangent;
 layout(location = 4) in ivec4 boneIds; 
 layout(location = 5) in vec4 weights;
+// influences 5-8, only read when boneInfluences is 8 (see SkeletalMesh.h)
+layout(location = 12) in ivec4 boneIds2;
+layout(location = 13) in vec4 weights2;
 	
 uniform mat4 projection;
 uniform mat4 view;
@@ -19,9 +22,11 @@ out mat3 TBN;
 
 
 // skeletal animation
-const int MAX_BONES = 200; //maybe higher than 100
+// one mesh's local palette; must match MAX_MESH_PALETTE in SkeletalMesh.h
+const int MAX_BONES = 64;
 const int MAX_BONE_INFLUENCE = 4;
 uniform mat4 finalBonesMatrices[MAX_BONES];
+uniform int boneInfluences;
 uniform bool skeletal;
 
 
@@ -29,7 +34,19 @@ uniform bool skeletal;
 // uniform mat4 lightSpaceMatrix;
 // out vec4 FragPosLightSpace;
 
-	
+
+// Influences are sorted by weight, so the first zero weight ends them.
+mat4 skinTransform()
+{
+    mat4 boneTransform = mat4(0.0);
+    for (int i = 0; i < 4 && weights[i] > 0.0; i++)
+        boneTransform += finalBonesMatrices[boneIds[i]] * weights[i];
+    if (boneInfluences > 4 && weights[3] > 0.0)
+        for (int i = 0; i < 4 && weights2[i] > 0.0; i++)
+            boneTransform += finalBonesMatrices[boneIds2[i]] * weights2[i];
+    return boneTransform;
+}
+
 void main()
 {
     // vec4 totalPosition = vec4(vPosition, 1.0);
@@ -51,12 +68,7 @@ void main()
         totalPosition = vec4(vPosition, 1.0);
     }
     else {
-        mat4 boneTransform = finalBonesMatrices[boneIds[0]] * weights[0];
-        boneTransform += finalBonesMatrices[boneIds[1]] * weights[1];
-        boneTransform += finalBonesMatrices[boneIds[2]] * weights[2];
-        boneTransform += finalBonesMatrices[boneIds[3]] * weights[3];
-
-        totalPosition = boneTransform * vec4(vPosition, 1.0);
+        totalPosition = skinTransform() * vec4(vPosition, 1.0);
     }
 		
     gl_Position =  projection * view * model * totalPosition;
@@ -0,0 +1,38 @@
+#version 430 core
+// Skins each vertex of a mesh once per frame. The outputs are captured with transform feedback
+// into the mesh's pre-skinned buffer, so the shadow and lighting passes can draw the result as a
+// static mesh instead of skinning it again.
+layout (location = 0) in vec3 vPosition;
+layout (location = 1) in vec3 vNormal;
+layout (location = 3) in vec3 vTangent;
+layout(location = 4) in ivec4 boneIds;
+layout(location = 5) in vec4 weights;
+// influences 5-8, only read when boneInfluences is 8 (see SkeletalMesh.h)
+layout(location = 12) in ivec4 boneIds2;
+layout(location = 13) in vec4 weights2;
+
+// one mesh's local palette; must match MAX_MESH_PALETTE in SkeletalMesh.h
+const int MAX_BONES = 64;
+uniform mat4 finalBonesMatrices[MAX_BONES];
+uniform int boneInfluences;
+
+// Captured in this order; must match SkinnedVertex in SkeletalMesh.h.
+out vec3 skinnedPosition;
+out vec3 skinnedNormal;
+out vec3 skinnedTangent;
+
+void main()
+{
+    // Influences are sorted by weight, so the first zero weight ends them.
+    mat4 boneTransform = mat4(0.0);
+    for (int i = 0; i < 4 && weights[i] > 0.0; i++)
+        boneTransform += finalBonesMatrices[boneIds[i]] * weights[i];
+    if (boneInfluences > 4 && weights[3] > 0.0)
+        for (int i = 0; i < 4 && weights2[i] > 0.0; i++)
+            boneTransform += finalBonesMatrices[boneIds2[i]] * weights2[i];
+
+    skinnedPosition = vec3(boneTransform * vec4(vPosition, 1.0));
+    mat3 boneRotation = mat3(boneTransform);
+    skinnedNormal = normalize(boneRotation * vNormal);
+    skinnedTangent = normalize(boneRotation * vTangent);
+}